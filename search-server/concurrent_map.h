@@ -1,63 +1,75 @@
-#include <algorithm>
-#include <cstdlib>
-#include <future>
-#include <map>
-#include <numeric>
-#include <random>
-#include <string>
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
-using namespace std::string_literals;
-
+// Lock-free map accumulating values by integer key: open addressing with linear probing,
+// keys are claimed and values added with compare-and-swap. The capacity is fixed,
+// so expected_size passed to the constructor must bound the number of distinct keys.
 template <typename Key, typename Value>
 class ConcurrentMap {
-private:
-    struct Bucket {
-        std::mutex mutex;
-        std::map<Key, Value> map;
-    };
-    
-    size_t GetBucket(const Key& key) {
-        return static_cast<uint64_t>(key) % buckets_.size();
-    }
- 
 public:
-    static_assert(std::is_integral_v<Key>, "ConcurrentMap supports only integer keys"s);
- 
-    struct Access {
-        std::lock_guard<std::mutex> guard;
-        Value& ref_to_value;
- 
-        Access(const Key& key, Bucket& bucket)
-            : guard(bucket.mutex)
-            , ref_to_value(bucket.map[key]) {
+    static_assert(std::is_integral_v<Key>, "ConcurrentMap supports only integer keys");
+    static_assert(std::is_arithmetic_v<Value>, "ConcurrentMap supports only arithmetic values");
+
+    explicit ConcurrentMap(size_t expected_size) {
+        // Keep the load factor under one half
+        size_t capacity = 16;
+        while (capacity < expected_size * 2) {
+            capacity *= 2;
         }
-    };
- 
-    explicit ConcurrentMap(size_t bucket_count)
-        : buckets_(bucket_count) {
+        slots_ = std::vector<Slot>(capacity);
+        mask_ = capacity - 1;
     }
- 
-    Access operator[](const Key& key) {
-        size_t bucket_index = GetBucket(key);
-        return {key, buckets_[bucket_index]};
+
+    // Safe to call concurrently for any keys
+    void Add(Key key, Value value) {
+        for (size_t slot_index = GetSlot(key);; slot_index = (slot_index + 1) & mask_) {
+            Slot& slot = slots_[slot_index];
+            Key slot_key = slot.key.load(std::memory_order_acquire);
+            if (slot_key == EMPTY_KEY) {
+                if (slot.key.compare_exchange_strong(slot_key, key, std::memory_order_acq_rel)) {
+                    slot_key = key;
+                }
+                // Otherwise slot_key now holds the key of the thread that won the slot
+            }
+            if (slot_key == key) {
+                Value current = slot.value.load(std::memory_order_relaxed);
+                while (!slot.value.compare_exchange_weak(current, current + value, std::memory_order_relaxed)) {
+                }
+                return;
+            }
+        }
     }
- 
-    std::map<Key, Value> BuildOrdinaryMap() {
-        std::map<Key, Value> result;
-        for (auto& [mutex, map] : buckets_) {
-            std::lock_guard g(mutex);
-            result.insert(map.begin(), map.end());
+
+    // Must not run concurrently with Add
+    std::vector<std::pair<Key, Value>> BuildVector() const {
+        std::vector<std::pair<Key, Value>> result;
+        for (const Slot& slot : slots_) {
+            const Key key = slot.key.load(std::memory_order_relaxed);
+            if (key != EMPTY_KEY) {
+                result.emplace_back(key, slot.value.load(std::memory_order_relaxed));
+            }
         }
         return result;
     }
-    
-    void erase(const Key& key) {
-        size_t bucket_index = GetBucket(key);
-        buckets_[bucket_index].map.erase(key);
-        return;
-    }
- 
+
 private:
-    std::vector<Bucket> buckets_;
-};
\ No newline at end of file
+    static constexpr Key EMPTY_KEY = std::numeric_limits<Key>::max();
+
+    struct Slot {
+        std::atomic<Key> key{EMPTY_KEY};
+        std::atomic<Value> value{};
+    };
+
+    size_t GetSlot(Key key) const {
+        // Fibonacci hashing spreads consecutive keys over the table
+        return static_cast<size_t>(static_cast<uint64_t>(key) * 0x9E3779B97F4A7C15ull >> 32) & mask_;
+    }
+
+    std::vector<Slot> slots_;
+    size_t mask_ = 0;
+};
@@ -0,0 +1,81 @@
+#include "concurrent_search_server.h"
+#include <deque>
+#include <execution>
+#include <memory>
+#include <thread>
+using namespace std;
+
+ConcurrentSearchServer::ReadGuard::ReadGuard(const ConcurrentSearchServer& server)
+    : server_(server) {
+    while (true) {
+        side_ = server_.published_side_.load();
+        server_.reader_counts_[side_].fetch_add(1);
+        // The side could have been retired before the reader registered on it
+        if (server_.published_side_.load() == side_) {
+            break;
+        }
+        server_.reader_counts_[side_].fetch_sub(1);
+    }
+}
+
+ConcurrentSearchServer::ReadGuard::~ReadGuard() {
+    server_.reader_counts_[side_].fetch_sub(1);
+}
+
+void ConcurrentSearchServer::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
+    Modify([document_id, document = string(document), status, ratings](SearchServer& server) {
+        server.AddDocument(document_id, document, status, ratings);
+    });
+}
+
+void ConcurrentSearchServer::AddDocuments(const vector<RawDocument>& documents) {
+    // The batch is replayed later, so it needs its own copy of the texts
+    struct Batch {
+        deque<string> texts;
+        vector<RawDocument> documents;
+    };
+    auto batch = make_shared<Batch>();
+    batch->documents = documents;
+    for (RawDocument& document : batch->documents) {
+        document.text = batch->texts.emplace_back(document.text);
+    }
+    Modify([batch](SearchServer& server) {
+        server.AddDocuments(execution::par, batch->documents);
+    });
+}
+
+void ConcurrentSearchServer::RemoveDocument(int document_id) {
+    Modify([document_id](SearchServer& server) {
+        server.RemoveDocument(document_id);
+    });
+}
+
+void ConcurrentSearchServer::SetScoringMode(ScoringMode mode) {
+    Modify([mode](SearchServer& server) {
+        server.SetScoringMode(mode);
+    });
+}
+
+int ConcurrentSearchServer::GetDocumentCount() const {
+    return Read([](const SearchServer& server) {
+        return server.GetDocumentCount();
+    });
+}
+
+void ConcurrentSearchServer::Modify(Modification modification) {
+    lock_guard guard(write_mutex_);
+    const int retired_side = 1 - published_side_.load();
+    // Wait for the queries which started before the previous swap
+    while (reader_counts_[retired_side].load() != 0) {
+        this_thread::yield();
+    }
+    for (const Modification& pending : pending_modifications_) {
+        pending(sides_[retired_side]);
+    }
+    pending_modifications_.clear();
+
+    // Both sides are equal now. If the modification throws, nothing has been changed
+    modification(sides_[retired_side]);
+    published_side_.store(retired_side);
+    pending_modifications_.push_back(move(modification));
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include "search_server.h"
+#include <array>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+// SearchServer which can be modified while queries run on other threads.
+// Two copies of the index are kept (left-right scheme): queries read the published copy
+// without locks, a writer modifies the other copy and publishes it by an atomic swap.
+// The modification is replayed on the retired copy once its last reader has left,
+// so readers never wait, and writers wait only for queries started before the previous swap.
+class ConcurrentSearchServer {
+public:
+    template <typename StringContainer>
+    explicit ConcurrentSearchServer(const StringContainer& stop_words)
+        : sides_{SearchServer(stop_words), SearchServer(stop_words)} {
+    }
+
+    explicit ConcurrentSearchServer(const std::string& stop_words_text)
+        : sides_{SearchServer(stop_words_text), SearchServer(stop_words_text)} {
+    }
+
+    explicit ConcurrentSearchServer(std::string_view stop_words_text)
+        : sides_{SearchServer(stop_words_text), SearchServer(stop_words_text)} {
+    }
+
+    ConcurrentSearchServer(const ConcurrentSearchServer&) = delete;
+    ConcurrentSearchServer& operator=(const ConcurrentSearchServer&) = delete;
+
+    // Modifications are serialized between writers, but don't block queries.
+    // Both copies are modified, so a RemoveDocument which purges the index purges it twice
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+    void AddDocuments(const std::vector<RawDocument>& documents);
+    void RemoveDocument(int document_id);
+    void SetScoringMode(ScoringMode mode);
+
+    // Runs reader(const SearchServer&) on the currently published index version.
+    // The version stays unchanged until reader returns, so several calls inside it
+    // (e.g. ProcessQueries or MatchDocument over the ids) see consistent data.
+    // References to the index must not outlive the call.
+    template <typename Reader>
+    decltype(auto) Read(Reader reader) const {
+        const ReadGuard guard(*this);
+        return reader(static_cast<const SearchServer&>(sides_[guard.GetSide()]));
+    }
+
+    template <typename... Args>
+    auto FindTopDocuments(Args&&... args) const {
+        return Read([&](const SearchServer& server) {
+            return server.FindTopDocuments(std::forward<Args>(args)...);
+        });
+    }
+
+    template <typename... Args>
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(Args&&... args) const {
+        return Read([&](const SearchServer& server) {
+            return server.MatchDocument(std::forward<Args>(args)...);
+        });
+    }
+
+    int GetDocumentCount() const;
+
+private:
+    using Modification = std::function<void(SearchServer&)>;
+
+    // Registers a reader on the published side; the side can't be modified while registered
+    class ReadGuard {
+    public:
+        explicit ReadGuard(const ConcurrentSearchServer& server);
+        ~ReadGuard();
+
+        ReadGuard(const ReadGuard&) = delete;
+        ReadGuard& operator=(const ReadGuard&) = delete;
+
+        int GetSide() const {
+            return side_;
+        }
+
+    private:
+        const ConcurrentSearchServer& server_;
+        int side_;
+    };
+
+    std::array<SearchServer, 2> sides_;
+    std::atomic<int> published_side_{0};
+    mutable std::array<std::atomic<int>, 2> reader_counts_{};
+
+    std::mutex write_mutex_;
+    // Modifications already published but not yet applied to the retired side
+    std::vector<Modification> pending_modifications_;
+
+    void Modify(Modification modification);
+};
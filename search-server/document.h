@@ -1,5 +1,7 @@
 #pragma once
 #include <iostream>
+#include <string_view>
+#include <vector>
 
 enum class DocumentStatus {
     ACTUAL,
@@ -8,6 +10,8 @@ enum class DocumentStatus {
     REMOVED,
 };
 
+const int DOCUMENT_STATUS_COUNT = 4;
+
 struct Document {
     Document() = default;
     Document(int id, double relevance, int rating)
@@ -20,4 +24,12 @@ struct Document {
     int rating = 0;
 };
 
+// Document to be added by SearchServer::AddDocuments, the text is only read during the call
+struct RawDocument {
+    int id = 0;
+    std::string_view text;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::vector<int> ratings;
+};
+
 std::ostream& operator<< (std::ostream &out, const Document &doc);
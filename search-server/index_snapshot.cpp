@@ -0,0 +1,79 @@
+#include "index_snapshot.h"
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+using namespace std;
+
+namespace {
+
+void SyncPath(const string& path) {
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw runtime_error("Can't open "s + path);
+    }
+    const int result = fsync(fd);
+    close(fd);
+    if (result != 0) {
+        throw runtime_error("Can't sync "s + path);
+    }
+}
+
+string GetDirectory(const string& path) {
+    const size_t slash = path.find_last_of('/');
+    if (slash == string::npos) {
+        return "."s;
+    }
+    return slash == 0 ? "/"s : path.substr(0, slash);
+}
+
+} // namespace
+
+SnapshotWriter::SnapshotWriter(const string& path)
+    : path_(path)
+    , temporary_path_(path + ".tmp"s)
+    , out_(temporary_path_, ios::binary | ios::trunc) {
+    if (!out_) {
+        throw runtime_error("Can't open "s + temporary_path_ + " for writing"s);
+    }
+}
+
+SnapshotWriter::~SnapshotWriter() {
+    if (!is_finished_) {
+        out_.close();
+        remove(temporary_path_.c_str());
+    }
+}
+
+void SnapshotWriter::WriteString(string_view str) {
+    Write(static_cast<uint32_t>(str.size()));
+    out_.write(str.data(), str.size());
+}
+
+void SnapshotWriter::Finish() {
+    out_.close();
+    if (!out_) {
+        throw runtime_error("Failed to write snapshot"s);
+    }
+    // The data must be on disk before the rename is, and the rename before Finish returns
+    SyncPath(temporary_path_);
+    if (rename(temporary_path_.c_str(), path_.c_str()) != 0) {
+        throw runtime_error("Can't replace "s + path_ + ": "s + strerror(errno));
+    }
+    is_finished_ = true;
+    SyncPath(GetDirectory(path_));
+}
+
+string_view SnapshotReader::ReadString() {
+    const uint32_t size = Read<uint32_t>();
+    return {Advance(size), size};
+}
+
+const char* SnapshotReader::Advance(size_t byte_count) {
+    if (byte_count > size_ - position_) {
+        throw runtime_error("Snapshot is truncated"s);
+    }
+    const char* result = data_ + position_;
+    position_ += byte_count;
+    return result;
+}
@@ -0,0 +1,134 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// Binary snapshot format of SearchServer. Values are stored in the native byte order,
+// the header lets a snapshot from an incompatible build be rejected.
+const char SNAPSHOT_MAGIC[8] = {'S', 'R', 'C', 'H', 'I', 'D', 'X', '\0'};
+const uint32_t SNAPSHOT_VERSION = 2;
+const uint32_t SNAPSHOT_BYTE_ORDER_MARK = 0x01020304;
+
+// Writes into path + ".tmp", which Finish renames over path. A crash never leaves a partial
+// snapshot at path, and a server loaded from path keeps its mapping of the replaced file
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(const std::string& path);
+
+    SnapshotWriter(const SnapshotWriter&) = delete;
+    SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+    // Removes the temporary file unless finished
+    ~SnapshotWriter();
+
+    template <typename T>
+    void Write(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        out_.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template <typename T>
+    void WriteArray(const std::vector<T>& values) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        Write(static_cast<uint64_t>(values.size()));
+        if (!values.empty()) {
+            out_.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+        }
+    }
+
+    void WriteString(std::string_view str);
+
+    // Syncs the file to disk and replaces path with it. Throws if anything failed to be written
+    void Finish();
+
+private:
+    std::string path_;
+    std::string temporary_path_;
+    std::ofstream out_;
+    bool is_finished_ = false;
+};
+
+// Writes values in the snapshot encoding into memory, e.g. messages read back by SnapshotReader
+class BufferWriter {
+public:
+    template <typename T>
+    BufferWriter& Write(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        data_.append(reinterpret_cast<const char*>(&value), sizeof(T));
+        return *this;
+    }
+
+    template <typename T>
+    BufferWriter& WriteArray(const std::vector<T>& values) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        Write(static_cast<uint64_t>(values.size()));
+        if (!values.empty()) {
+            data_.append(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+        }
+        return *this;
+    }
+
+    BufferWriter& WriteString(std::string_view str) {
+        Write(static_cast<uint32_t>(str.size()));
+        data_.append(str);
+        return *this;
+    }
+
+    const std::string& GetData() const {
+        return data_;
+    }
+
+    void Clear() {
+        data_.clear();
+    }
+
+private:
+    std::string data_;
+};
+
+// Reads a snapshot from memory without copying strings:
+// ReadString() returns views into the buffer
+class SnapshotReader {
+public:
+    SnapshotReader(const char* data, size_t size)
+        : data_(data)
+        , size_(size) {
+    }
+
+    template <typename T>
+    T Read() {
+        static_assert(std::is_trivially_copyable_v<T>);
+        T value;
+        std::memcpy(&value, Advance(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    template <typename T>
+    std::vector<T> ReadArray() {
+        static_assert(std::is_trivially_copyable_v<T>);
+        const uint64_t count = Read<uint64_t>();
+        if (count > (size_ - position_) / sizeof(T)) {
+            throw std::runtime_error("Snapshot is truncated");
+        }
+        std::vector<T> values(count);
+        // data() of an empty vector may be null, which memcpy doesn't accept even for 0 bytes
+        if (count > 0) {
+            std::memcpy(values.data(), Advance(count * sizeof(T)), count * sizeof(T));
+        }
+        return values;
+    }
+
+    std::string_view ReadString();
+
+private:
+    const char* data_;
+    size_t size_;
+    size_t position_ = 0;
+
+    const char* Advance(size_t byte_count);
+};
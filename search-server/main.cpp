@@ -1,8 +1,21 @@
+#include "concurrent_search_server.h"
+#include "mutation_log.h"
+#include "posting_list.h"
 #include "process_queries.h"
+#include "read_input_functions.h"
 #include "search_server.h"
+#include "sharded_search_server.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
 #include <execution>
+#include <fstream>
 #include <iostream>
+#include <limits>
 #include <string>
+#include <thread>
 #include <vector>
 using namespace std;
 
@@ -33,6 +46,541 @@ void Test() {
     check_search(SearchServer{stop_words});
     check_search(SearchServer{vector<string>{"и", "в", "на"}});
     check_search(SearchServer{set<string>{"и", "в", "на"}});
+
+    // запрос без слов отклоняется при любой политике
+    {
+        SearchServer search_server(stop_words);
+        search_server.AddDocument(0, "кот в мешке", DocumentStatus::ACTUAL, {1});
+        const auto is_rejected = [](auto search) {
+            try {
+                search();
+            } catch (const invalid_argument&) {
+                return true;
+            }
+            return false;
+        };
+        for (const string& query : {""s, "   "s}) {
+            if (!is_rejected([&] { search_server.FindTopDocuments(query); })
+                || !is_rejected([&] { search_server.FindTopDocuments(execution::par, query); })
+                || !is_rejected([&] { search_server.MatchDocument(query, 0); })
+                || !is_rejected([&] { search_server.MatchDocument(execution::par, query, 0); })) {
+                std::cout << "пустой запрос должен вызывать исключение" << std::endl;
+            }
+        }
+    }
+
+    // огромный top_k возвращает все найденные документы и ничего не выделяет заранее
+    {
+        SearchServer search_server(stop_words);
+        for (int document_id = 0; document_id < 10; ++document_id) {
+            search_server.AddDocument(document_id, "кот номер "s + to_string(document_id), DocumentStatus::ACTUAL, {document_id});
+        }
+        const size_t top_k = numeric_limits<size_t>::max();
+        for (const auto mode : {ScoringMode::EXHAUSTIVE, ScoringMode::MAX_SCORE}) {
+            search_server.SetScoringMode(mode);
+            if (search_server.FindTopDocuments("кот"s, DocumentStatus::ACTUAL, top_k).size() != 10
+                || search_server.FindTopDocuments(execution::par, "кот"s, DocumentStatus::ACTUAL, top_k).size() != 10) {
+                std::cout << "при огромном top_k должны возвращаться все найденные документы" << std::endl;
+            }
+        }
+    }
+
+    // шардированный сервер считает idf по всей коллекции и находит то же, что и один сервер
+    {
+        SearchServer single(stop_words);
+        ShardedSearchServer in_process(stop_words, 3);
+        ShardedSearchServer processes(stop_words, 2, ShardMode::PROCESS);
+        const vector<string> words = {"кот"s, "пёс"s, "мышь"s, "хвост"s, "ошейник"s, "в"s, "скворец"s, "усы"s};
+        for (int document_id = 0; document_id < 200; ++document_id) {
+            string text;
+            for (int i = 0; i < 2 + document_id % 5; ++i) {
+                text += words[(document_id * 7 + i * i * 3) % words.size()] + " "s;
+            }
+            const auto status = document_id % 3 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL;
+            single.AddDocument(document_id, text, status, {document_id % 10});
+            in_process.AddDocument(document_id, text, status, {document_id % 10});
+            processes.AddDocument(document_id, text, status, {document_id % 10});
+        }
+        for (int document_id = 0; document_id < 200; document_id += 9) {
+            single.RemoveDocument(document_id);
+            in_process.RemoveDocument(document_id);
+            processes.RemoveDocument(document_id);
+        }
+        if (in_process.GetDocumentCount() != single.GetDocumentCount() || processes.GetDocumentCount() != single.GetDocumentCount()) {
+            std::cout << "шардированный сервер должен хранить все документы" << std::endl;
+        }
+        for (const string& query : {"кот"s, "пёс усы -мышь"s, "скворец хвост ошейник"s, "кот пёс мышь хвост"s}) {
+            for (const auto status : {DocumentStatus::ACTUAL, DocumentStatus::BANNED}) {
+                const auto expected = single.FindTopDocuments(query, status);
+                for (const ShardedSearchServer* sharded : {&in_process, &processes}) {
+                    const auto found = sharded->FindTopDocuments(query, status);
+                    bool is_same = found.size() == expected.size();
+                    for (size_t i = 0; is_same && i < found.size(); ++i) {
+                        is_same = std::abs(found[i].relevance - expected[i].relevance) < 1e-12;
+                    }
+                    if (!is_same) {
+                        std::cout << "релевантность шардированного поиска должна совпадать с одним сервером" << std::endl;
+                    }
+                }
+            }
+            if (processes.MatchDocument(query, 10) != single.MatchDocument(query, 10)) {
+                std::cout << "MatchDocument шарда в другом процессе должен совпадать с одним сервером" << std::endl;
+            }
+        }
+    }
+
+    // пакет запросов находит то же, что и запросы по одному, склеенные результаты идут в порядке запросов
+    {
+        SearchServer search_server(stop_words);
+        for (int document_id = 0; document_id < 30; ++document_id) {
+            const string text = "кот номер "s + to_string(document_id % 4) + (document_id % 10 == 0 ? " лапа"s : ""s);
+            search_server.AddDocument(document_id, text, DocumentStatus::ACTUAL, {document_id});
+        }
+        // у запросов разное число результатов, в том числе ни одного
+        const vector<string> queries = {"кот"s, "лапа"s, "скворец"s, "номер 2"s, "лапа 3"s, "кот -номер"s};
+        vector<Document> expected;
+        for (const string& query : queries) {
+            for (const Document& document : search_server.FindTopDocuments(query)) {
+                expected.push_back(document);
+            }
+        }
+        vector<Document> streamed;
+        ProcessQueriesJoined(search_server, queries, [&](size_t, const vector<Document>& documents) {
+            streamed.insert(streamed.end(), documents.begin(), documents.end());
+        }, 2);
+        for (const auto& joined : {ProcessQueriesJoined(search_server, queries), streamed}) {
+            bool is_same = joined.size() == expected.size();
+            for (size_t i = 0; is_same && i < joined.size(); ++i) {
+                is_same = joined[i].id == expected[i].id && joined[i].relevance == expected[i].relevance;
+            }
+            if (!is_same) {
+                std::cout << "склеенные результаты пакета должны совпадать с запросами по одному" << std::endl;
+            }
+        }
+    }
+
+    // кэш результатов отдаёт повторный запрос без поиска, а после любого изменения индекса ищет заново
+    {
+        SearchServer cached(stop_words);
+        SearchServer uncached(stop_words);
+        cached.EnableQueryCache(10);
+        const auto add_document = [&](int document_id, const string& text) {
+            cached.AddDocument(document_id, text, DocumentStatus::ACTUAL, {document_id});
+            uncached.AddDocument(document_id, text, DocumentStatus::ACTUAL, {document_id});
+        };
+        const auto is_same = [&] {
+            const auto found = cached.FindTopDocuments("кот пёс"s, DocumentStatus::ACTUAL);
+            const auto expected = uncached.FindTopDocuments("кот пёс"s, DocumentStatus::ACTUAL);
+            bool is_same = found.size() == expected.size();
+            for (size_t i = 0; is_same && i < found.size(); ++i) {
+                is_same = found[i].id == expected[i].id && found[i].relevance == expected[i].relevance;
+            }
+            return is_same;
+        };
+        add_document(1, "кот в мешке"s);
+        add_document(2, "пёс и кот"s);
+        is_same();
+        // запрос нормализуется, так что порядок и повторы слов не важны
+        cached.FindTopDocuments("пёс кот кот"s, DocumentStatus::ACTUAL);
+        if (cached.GetQueryCacheStats().hit_count != 1) {
+            std::cout << "повторный запрос должен браться из кэша" << std::endl;
+        }
+        add_document(3, "пёс пёс кот"s);
+        const bool is_added = is_same();
+        cached.RemoveDocument(2);
+        uncached.RemoveDocument(2);
+        const bool is_removed = is_same();
+        cached.AddDocuments({{4, "кот кот кот", DocumentStatus::ACTUAL, {4}}});
+        uncached.AddDocuments({{4, "кот кот кот", DocumentStatus::ACTUAL, {4}}});
+        const bool is_batch_added = is_same();
+        if (!is_added || !is_removed || !is_batch_added) {
+            std::cout << "после изменения индекса кэш не должен отдавать устаревшие результаты" << std::endl;
+        }
+    }
+
+    // остановленный поиск помечается частичным и не попадает в кэш, неостановленный находит всё
+    {
+        SearchServer search_server(stop_words);
+        search_server.EnableQueryCache(10);
+        for (int document_id = 0; document_id < 100; ++document_id) {
+            search_server.AddDocument(document_id, "кот номер "s + to_string(document_id % 9), DocumentStatus::ACTUAL, {document_id});
+        }
+        SearchControl cancelled;
+        cancelled.token.Cancel();
+        SearchControl expired;
+        expired.deadline = chrono::steady_clock::now() - 1s;
+        for (const auto mode : {ScoringMode::EXHAUSTIVE, ScoringMode::MAX_SCORE}) {
+            search_server.SetScoringMode(mode);
+            for (const SearchControl& control : {cancelled, expired}) {
+                const SearchResult result = search_server.FindTopDocuments("кот номер 3"s, DocumentStatus::ACTUAL, control);
+                const SearchResult async_result = search_server.FindTopDocumentsAsync("кот номер 3"s, DocumentStatus::ACTUAL, control).get();
+                if (!result.is_partial || !result.documents.empty() || !async_result.is_partial) {
+                    std::cout << "отменённый или просроченный поиск должен быть частичным" << std::endl;
+                }
+            }
+            const SearchResult result = search_server.FindTopDocuments("кот номер 3"s, DocumentStatus::ACTUAL, SearchControl{});
+            const auto expected = search_server.FindTopDocuments("кот номер 3"s, DocumentStatus::ACTUAL);
+            bool is_same = !result.is_partial && !expected.empty() && result.documents.size() == expected.size();
+            for (size_t i = 0; is_same && i < expected.size(); ++i) {
+                is_same = result.documents[i].id == expected[i].id;
+            }
+            if (!is_same) {
+                std::cout << "поиск без остановки должен находить все документы, даже после частичного" << std::endl;
+            }
+        }
+    }
+
+    // читатели во время записи видят согласованные версии индекса, которые только растут
+    {
+        ConcurrentSearchServer search_server(stop_words);
+        for (int document_id = 0; document_id < 100; ++document_id) {
+            search_server.AddDocument(document_id, "кот номер "s + to_string(document_id), DocumentStatus::ACTUAL, {});
+        }
+        atomic<bool> is_written = false;
+        atomic<bool> is_consistent = true;
+        const auto read = [&] {
+            size_t last_added_count = 0;
+            while (!is_written) {
+                search_server.Read([&](const SearchServer& server) {
+                    const size_t top_k = numeric_limits<size_t>::max();
+                    const size_t added_count = server.FindTopDocuments("пёс"s, DocumentStatus::ACTUAL, top_k).size();
+                    const size_t count = server.FindTopDocuments("кот"s, DocumentStatus::ACTUAL, top_k).size() + added_count;
+                    if (count != static_cast<size_t>(server.GetDocumentCount()) || added_count < last_added_count) {
+                        is_consistent = false;
+                    }
+                    last_added_count = added_count;
+                });
+            }
+        };
+        thread first_reader(read);
+        thread second_reader(read);
+        // удаляются все исходные документы, так что удалённые успевают вычиститься
+        for (int i = 0; i < 300; ++i) {
+            search_server.AddDocument(1000 + i, "пёс номер "s + to_string(i), DocumentStatus::ACTUAL, {});
+            if (i % 3 == 0) {
+                search_server.RemoveDocument(i / 3);
+            }
+        }
+        is_written = true;
+        first_reader.join();
+        second_reader.join();
+        if (!is_consistent || search_server.GetDocumentCount() != 300
+            || search_server.FindTopDocuments("кот"s, DocumentStatus::ACTUAL, size_t{1000}).size() != 0) {
+            std::cout << "чтение во время записи должно видеть согласованный индекс" << std::endl;
+        }
+    }
+
+    // после вычистки удалённых документов и сжатия словаря поиск не отличается от нового сервера с теми же документами
+    {
+        const string snapshot_path = "search_server_test.snapshot"s;
+        const auto add_document = [](SearchServer& search_server, int document_id) {
+            // у документов разное число слов «кот», так что и частоты разные
+            string text;
+            for (int i = 0; i <= document_id % 3; ++i) {
+                text += "кот "s;
+            }
+            text += "номер "s + to_string(document_id % 7) + " уникальное"s + to_string(document_id);
+            const auto status = document_id % 2 == 0 ? DocumentStatus::ACTUAL : DocumentStatus::BANNED;
+            search_server.AddDocument(document_id, text, status, {document_id});
+        };
+        const auto is_removed = [](int document_id) {
+            return document_id < 60 && document_id % 2 == 0;
+        };
+        const auto is_same = [](const SearchServer& found_server, const SearchServer& expected_server) {
+            if (found_server.GetDocumentCount() != expected_server.GetDocumentCount()
+                || !std::equal(found_server.begin(), found_server.end(), expected_server.begin(), expected_server.end())) {
+                return false;
+            }
+            const auto get_word_frequencies = [](const SearchServer& search_server, int document_id) {
+                vector<pair<string, double>> word_frequencies;
+                for (const auto& [word, freq] : search_server.GetWordFrequencies(document_id)) {
+                    word_frequencies.emplace_back(word, freq);
+                }
+                // слова идут в порядке номеров термов, а они у серверов разные
+                std::sort(word_frequencies.begin(), word_frequencies.end());
+                return word_frequencies;
+            };
+            for (const int document_id : expected_server) {
+                if (get_word_frequencies(found_server, document_id) != get_word_frequencies(expected_server, document_id)) {
+                    return false;
+                }
+            }
+            for (const string& query : {"кот"s, "номер 3 -кот"s, "номер 5 уникальное77"s, "уникальное12 уникальное45"s}) {
+                for (const auto status : {DocumentStatus::ACTUAL, DocumentStatus::BANNED}) {
+                    const auto found = found_server.FindTopDocuments(query, status);
+                    const auto expected = expected_server.FindTopDocuments(query, status);
+                    if (found.size() != expected.size()) {
+                        return false;
+                    }
+                    for (size_t i = 0; i < found.size(); ++i) {
+                        if (found[i].id != expected[i].id || std::abs(found[i].relevance - expected[i].relevance) > 1e-12) {
+                            return false;
+                        }
+                    }
+                }
+                for (const int document_id : expected_server) {
+                    if (found_server.MatchDocument(query, document_id) != expected_server.MatchDocument(query, document_id)) {
+                        return false;
+                    }
+                }
+            }
+            return true;
+        };
+
+        // на каждый удалённый приходится меньше PURGE_RATIO документов, так что удаления вызывают вычистку
+        SearchServer search_server(stop_words);
+        for (int document_id = 0; document_id < 80; ++document_id) {
+            add_document(search_server, document_id);
+        }
+        search_server.SaveSnapshot(snapshot_path);
+        SearchServer loaded = SearchServer::LoadSnapshot(snapshot_path);
+        for (int document_id = 0; document_id < 80; ++document_id) {
+            if (is_removed(document_id)) {
+                search_server.RemoveDocument(document_id);
+                loaded.RemoveDocument(document_id);
+            }
+        }
+        // сжатый словарь больше не ссылается на файл снимка
+        std::ofstream(snapshot_path, ios::binary | ios::trunc) << string(1000, 'x');
+        SearchServer expected(stop_words);
+        for (int document_id = 0; document_id < 100; ++document_id) {
+            if (document_id >= 80) {
+                add_document(search_server, document_id);
+                add_document(loaded, document_id);
+            }
+            if (!is_removed(document_id)) {
+                add_document(expected, document_id);
+            }
+        }
+        if (!is_same(search_server, expected) || !is_same(loaded, expected)) {
+            std::cout << "после вычистки удалённых документов поиск должен находить то же, что и новый сервер" << std::endl;
+        }
+        std::remove(snapshot_path.c_str());
+    }
+
+    // сервер, загруженный из снимка, может перезаписать этот же снимок
+    {
+        const string snapshot_path = "search_server_test.snapshot"s;
+        SearchServer search_server(stop_words);
+        for (int document_id = 0; document_id < 100; ++document_id) {
+            search_server.AddDocument(document_id, "кот номер "s + to_string(document_id), DocumentStatus::ACTUAL, {document_id});
+        }
+        search_server.SaveSnapshot(snapshot_path);
+        SearchServer loaded = SearchServer::LoadSnapshot(snapshot_path);
+        loaded.AddDocument(100, "пёс номер 100"s, DocumentStatus::ACTUAL, {});
+        loaded.SaveSnapshot(snapshot_path);
+        const SearchServer reloaded = SearchServer::LoadSnapshot(snapshot_path);
+        for (const string& query : {"кот 7"s, "пёс"s, "номер"s}) {
+            const auto expected = loaded.FindTopDocuments(query);
+            const auto found = reloaded.FindTopDocuments(query);
+            bool is_same = found.size() == expected.size() && !found.empty();
+            for (size_t i = 0; is_same && i < found.size(); ++i) {
+                is_same = found[i].id == expected[i].id && found[i].relevance == expected[i].relevance;
+            }
+            if (!is_same || loaded.MatchDocument(query, 7) != reloaded.MatchDocument(query, 7)) {
+                std::cout << "перезаписанный снимок должен загружаться с теми же документами" << std::endl;
+            }
+        }
+        std::remove(snapshot_path.c_str());
+    }
+
+    // ошибка в корпусе сообщается с файлом и строкой, документы до неё остаются добавленными
+    {
+        const string corpus_path = "search_server_test.tsv"s;
+        const auto load = [&](const string& contents, string& error) {
+            std::ofstream(corpus_path, ios::binary | ios::trunc) << contents;
+            SearchServer search_server(stop_words);
+            try {
+                LoadCorpus(search_server, corpus_path, 2);
+            } catch (const invalid_argument& e) {
+                error = e.what();
+            }
+            return vector<int>(search_server.begin(), search_server.end());
+        };
+        const string head = "1\tACTUAL\t1 2\tкот в мешке\n\n2\tBANNED\t\tпёс\n"s;
+        string error;
+        if (load(head + "3\tACTUAL\t5\tмышь\n"s, error) != vector<int>{1, 2, 3} || !error.empty()) {
+            std::cout << "корректный корпус должен загружаться целиком" << std::endl;
+        }
+        // строка с неизвестным статусом: разбор прерывается на ней
+        const auto kept_before_malformed = load(head + "3\tACTUAL\t5\tмышь\n4\tUNKNOWN\t\tскворец\n5\tACTUAL\t\tусы\n"s, error);
+        if (kept_before_malformed != vector<int>{1, 2, 3} || error.rfind(corpus_path + ":5: "s, 0) != 0) {
+            std::cout << "ошибка разбора должна указывать строку, документы до неё должны остаться" << std::endl;
+        }
+        // повторный id отклоняет сервер, пакет добавляется по одному документу до отклонённого
+        error.clear();
+        const auto kept_before_rejected = load(head + "3\tACTUAL\t\tусы\n1\tACTUAL\t\tдубль\n4\tACTUAL\t\tлапа\n"s, error);
+        if (kept_before_rejected != vector<int>{1, 2, 3} || error.rfind(corpus_path + ":5: "s, 0) != 0) {
+            std::cout << "отклонённый сервером документ должен сообщаться со своей строкой" << std::endl;
+        }
+        std::remove(corpus_path.c_str());
+    }
+
+    // журнал изменений восстанавливает документы поверх снимка, оборванная запись в конце отбрасывается
+    {
+        const string log_path = "search_server_test.wal"s;
+        const string snapshot_path = "search_server_test.snapshot"s;
+        std::remove(log_path.c_str());
+        const auto describe = [](const SearchServer& search_server) {
+            string description;
+            for (const int document_id : search_server) {
+                description += to_string(document_id) + ":"s;
+                for (const auto& [word, freq] : search_server.GetWordFrequencies(document_id)) {
+                    description += string(word) + "="s + to_string(freq) + " "s;
+                }
+            }
+            return description;
+        };
+
+        SearchServer search_server(stop_words);
+        string expected;
+        {
+            MutationLog log(log_path, search_server);
+            for (int document_id = 0; document_id < 50; ++document_id) {
+                const string text = "кот номер "s + to_string(document_id % 7);
+                search_server.AddDocument(document_id, text, DocumentStatus::ACTUAL, {});
+                log.AppendAddDocument(document_id, text, DocumentStatus::ACTUAL, {});
+            }
+            search_server.RemoveDocument(3);
+            log.WaitDurable(log.AppendRemoveDocument(3));
+            search_server.SaveSnapshot(snapshot_path);
+            search_server.AddDocument(3, "пёс вернулся", DocumentStatus::BANNED, {5});
+            log.WaitDurable(log.AppendAddDocument(3, "пёс вернулся", DocumentStatus::BANNED, {5}));
+            expected = describe(search_server);
+        }
+        std::ofstream(log_path, ios::binary | ios::app) << "\x40\x00\x00\x00оборвано"s;
+
+        SearchServer replayed(stop_words);
+        {
+            MutationLog log(log_path, replayed);
+        }
+        if (describe(replayed) != expected) {
+            std::cout << "журнал должен восстановить все записи до оборванной" << std::endl;
+        }
+
+        // сбой между сохранением снимка и очисткой журнала: журнал повторяется поверх снимка, в котором его записи уже есть
+        SearchServer from_snapshot = SearchServer::LoadSnapshot(snapshot_path);
+        {
+            MutationLog log(log_path, from_snapshot);
+            if (describe(from_snapshot) != expected) {
+                std::cout << "повтор журнала поверх снимка не должен ничего менять" << std::endl;
+            }
+            log.Checkpoint(from_snapshot, snapshot_path);
+            from_snapshot.RemoveDocument(7);
+            log.AppendRemoveDocument(7);
+            expected = describe(from_snapshot);
+        }
+        SearchServer after_checkpoint = SearchServer::LoadSnapshot(snapshot_path);
+        if (MutationLog(log_path, after_checkpoint).GetReplayedCount() != 1 || describe(after_checkpoint) != expected) {
+            std::cout << "после контрольной точки журнал должен содержать только новые записи" << std::endl;
+        }
+        std::remove(log_path.c_str());
+        std::remove(snapshot_path.c_str());
+    }
+
+    // сжатые блоки с разностями id и частотами шириной 1, 2 и 4 байта, до и после границы хвоста
+    for (const auto& [id_step, count_base] : {pair{1, 1u}, pair{300, 1000u}, pair{100000, 100000u}}) {
+        for (const size_t size : {PostingList::BLOCK_SIZE - 1, PostingList::BLOCK_SIZE, PostingList::BLOCK_SIZE + 1,
+                                  3 * PostingList::BLOCK_SIZE}) {
+            PostingList postings;
+            vector<pair<int, uint32_t>> expected;
+            for (size_t i = 0; i < size; ++i) {
+                expected.emplace_back(static_cast<int>(i) * id_step, count_base + static_cast<uint32_t>(i));
+                postings.Insert(expected.back().first, expected.back().second, 1.0);
+            }
+
+            vector<pair<int, uint32_t>> decoded;
+            postings.ForEach(0, numeric_limits<int>::max(), [&](int document_id, uint32_t term_count) {
+                decoded.emplace_back(document_id, term_count);
+            });
+            if (decoded != expected) {
+                std::cout << "ForEach должен вернуть все вставленные документы" << std::endl;
+            }
+
+            decoded.clear();
+            for (PostingList::Cursor cursor(postings); !cursor.IsEnd(); cursor.Next()) {
+                decoded.emplace_back(cursor.GetDocumentId(), cursor.GetTermCount());
+            }
+            if (decoded != expected) {
+                std::cout << "курсор должен пройти все вставленные документы" << std::endl;
+            }
+
+            for (size_t i = 0; i < size; i += 7) {
+                PostingList::Cursor cursor(postings);
+                cursor.Seek(expected[i].first - (id_step > 1 ? 1 : 0));
+                if (cursor.IsEnd() || cursor.GetDocumentId() != expected[i].first || cursor.GetTermCount() != expected[i].second) {
+                    std::cout << "Seek должен остановиться на первом документе с id не меньше заданного" << std::endl;
+                }
+            }
+        }
+    }
+
+    // MAX_SCORE пропускает документы, не попадающие в топ, и находит то же, что и полный перебор
+    {
+        SearchServer search_server(stop_words);
+        const vector<string> words = {"кот"s, "пёс"s, "мышь"s, "хвост"s, "ошейник"s, "усы"s, "лапа"s, "скворец"s};
+        for (int document_id = 0; document_id < 3000; ++document_id) {
+            string text;
+            for (int i = 0; i < 1 + (document_id * 7) % 17; ++i) {
+                text += words[(document_id * 3 + i * i) % (i % 3 == 0 ? 3 : words.size())] + " "s;
+            }
+            const auto status = document_id % 5 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL;
+            search_server.AddDocument(document_id, text, status, {document_id % 7});
+        }
+        for (const string& query : {"кот"s, "кот пёс мышь"s, "скворец лапа усы -хвост"s, "ошейник скворец"s}) {
+            for (const auto status : {DocumentStatus::ACTUAL, DocumentStatus::BANNED}) {
+                for (const size_t top_k : {size_t{1}, size_t{5}, size_t{50}}) {
+                    search_server.SetScoringMode(ScoringMode::EXHAUSTIVE);
+                    const auto expected = search_server.FindTopDocuments(query, status, top_k);
+                    search_server.SetScoringMode(ScoringMode::MAX_SCORE);
+                    const auto found = search_server.FindTopDocuments(query, status, top_k);
+                    // документы с равной релевантностью могут идти в другом порядке
+                    bool is_same = found.size() == expected.size();
+                    for (size_t i = 0; is_same && i < found.size(); ++i) {
+                        is_same = std::abs(found[i].relevance - expected[i].relevance) < 1e-12;
+                    }
+                    if (!is_same) {
+                        std::cout << "MAX_SCORE должен находить те же документы, что и полный перебор" << std::endl;
+                    }
+                }
+            }
+        }
+    }
+
+    // квантованные частоты дают почти те же оценки, что и точные, при последовательном и параллельном поиске
+    {
+        SearchServer search_server(stop_words);
+        const vector<string> words = {"кот"s, "пёс"s, "мышь"s, "хвост"s, "ошейник"s, "усы"s, "лапа"s};
+        for (int document_id = 0; document_id < 2000; ++document_id) {
+            string text = document_id % 20 == 0 ? "скворец "s : ""s;
+            for (int i = 0; i < 1 + document_id % 13; ++i) {
+                text += words[(document_id + i * i) % words.size()] + " "s;
+            }
+            search_server.AddDocument(document_id, text, DocumentStatus::ACTUAL, {document_id % 10});
+        }
+        const auto find_relevances = [&](ScoringMode mode, auto policy, const string& query) {
+            search_server.SetScoringMode(mode);
+            map<int, double> relevances;
+            for (const Document& document : search_server.FindTopDocuments(policy, query, DocumentStatus::ACTUAL, 2000)) {
+                relevances[document.id] = document.relevance;
+            }
+            return relevances;
+        };
+        // редкое слово ищется параллельно по разреженному пути
+        for (const string& query : {"кот пёс -усы"s, "скворец лапа"s}) {
+            const auto exact = find_relevances(ScoringMode::EXHAUSTIVE, execution::seq, query);
+            for (const auto& quantized : {find_relevances(ScoringMode::QUANTIZED, execution::seq, query),
+                                          find_relevances(ScoringMode::QUANTIZED, execution::par, query)}) {
+                bool is_close = quantized.size() == exact.size();
+                for (const auto& [document_id, relevance] : exact) {
+                    is_close = is_close && quantized.count(document_id) > 0 && std::abs(quantized.at(document_id) - relevance) < 1e-4;
+                }
+                if (!is_close) {
+                    std::cout << "квантованная оценка должна находить те же документы с близкой релевантностью" << std::endl;
+                }
+            }
+        }
+    }
 }
 
 int main() {
@@ -0,0 +1,34 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Read-only memory mapping of a whole file, unmapped on destruction
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile();
+
+    const char* data() const {
+        return data_;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    std::string_view GetContents() const {
+        return {data_, size_};
+    }
+
+    // Lets the kernel read ahead aggressively, for files read once from start to end
+    void AdviseSequential() const;
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+};
@@ -0,0 +1,122 @@
+#pragma once
+#include "posting_list.h"
+#include "top_documents.h"
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+struct ScoredTerm {
+    const PostingList* postings;
+    double inverse_document_freq;
+};
+
+// Buffers of the traversal, reused between queries
+struct MaxScoreScratch {
+    std::vector<double> upper_bounds;
+    std::vector<PostingList::Cursor> cursors;
+    std::vector<PostingList::Cursor> excluded_cursors;
+};
+
+// MaxScore traversal with block-max bounds. Documents are visited in index order;
+// a document is skipped only if the upper bound of its relevance can't bring it
+// into the current top, so the result is the same as with exhaustive scoring.
+// is_accepted(index) filters documents, get_inv_word_count(index) turns term counts
+// into term frequencies, make_document(index, relevance) builds a Document. terms are reordered.
+// should_stop() is checked before the first document and then periodically; if it returns true,
+// the current document and the ones after it are skipped.
+template <typename DocumentFilter, typename DocumentScale, typename DocumentMaker, typename StopCondition>
+void CollectTopDocumentsMaxScore(std::vector<ScoredTerm>& terms, const std::vector<const PostingList*>& excluded,
+                                 DocumentFilter is_accepted, DocumentScale get_inv_word_count, DocumentMaker make_document,
+                                 StopCondition should_stop, TopDocumentsCollector& collector, MaxScoreScratch& scratch) {
+    // Bounds are compared with some slack, since scores are summed in a different order
+    const double bound_slack = 1e-9;
+    const int no_document = std::numeric_limits<int>::max();
+    const size_t stop_check_interval = 1024;
+    size_t visited_count = 0;
+
+    std::sort(terms.begin(), terms.end(), [](const ScoredTerm& lhs, const ScoredTerm& rhs) {
+        return lhs.postings->GetMaxTermFreq() * lhs.inverse_document_freq
+            < rhs.postings->GetMaxTermFreq() * rhs.inverse_document_freq;
+    });
+    const size_t term_count = terms.size();
+    // upper_bounds[i] is the maximal relevance gained from terms [0, i)
+    std::vector<double>& upper_bounds = scratch.upper_bounds;
+    upper_bounds.assign(term_count + 1, 0.0);
+    std::vector<PostingList::Cursor>& cursors = scratch.cursors;
+    cursors.clear();
+    for (size_t i = 0; i < term_count; ++i) {
+        upper_bounds[i + 1] = upper_bounds[i] + terms[i].postings->GetMaxTermFreq() * terms[i].inverse_document_freq;
+        cursors.emplace_back(*terms[i].postings);
+    }
+    std::vector<PostingList::Cursor>& excluded_cursors = scratch.excluded_cursors;
+    excluded_cursors.clear();
+    for (const PostingList* postings : excluded) {
+        excluded_cursors.emplace_back(*postings);
+    }
+
+    // Terms before first_essential can't bring a document into the top on their own
+    size_t first_essential = 0;
+    // A document gets into the top only if its relevance is above threshold
+    double threshold = -std::numeric_limits<double>::infinity();
+
+    const auto is_at = [](const PostingList::Cursor& cursor, int document) {
+        return !cursor.IsEnd() && cursor.GetDocumentId() == document;
+    };
+
+    while (true) {
+        int document = no_document;
+        for (size_t i = first_essential; i < term_count; ++i) {
+            if (!cursors[i].IsEnd()) {
+                document = std::min(document, cursors[i].GetDocumentId());
+            }
+        }
+        if (document == no_document || (visited_count++ % stop_check_interval == 0 && should_stop())) {
+            break;
+        }
+
+        double bound = upper_bounds[first_essential];
+        for (size_t i = first_essential; i < term_count; ++i) {
+            if (is_at(cursors[i], document)) {
+                bound += cursors[i].GetBlockMaxTermFreq() * terms[i].inverse_document_freq;
+            }
+        }
+
+        bool is_candidate = bound + bound_slack > threshold && is_accepted(document);
+        for (size_t i = 0; is_candidate && i < excluded_cursors.size(); ++i) {
+            excluded_cursors[i].Seek(document);
+            is_candidate = !is_at(excluded_cursors[i], document);
+        }
+
+        const double inv_word_count = is_candidate ? get_inv_word_count(document) : 0.0;
+        double relevance = 0.0;
+        for (size_t i = first_essential; i < term_count; ++i) {
+            if (is_at(cursors[i], document)) {
+                if (is_candidate) {
+                    relevance += cursors[i].GetTermCount() * inv_word_count * terms[i].inverse_document_freq;
+                }
+                cursors[i].Next();
+            }
+        }
+
+        for (size_t i = first_essential; is_candidate && i > 0; --i) {
+            if (relevance + upper_bounds[i] + bound_slack <= threshold) {
+                is_candidate = false;
+                break;
+            }
+            cursors[i - 1].Seek(document);
+            if (is_at(cursors[i - 1], document)) {
+                relevance += cursors[i - 1].GetTermCount() * inv_word_count * terms[i - 1].inverse_document_freq;
+            }
+        }
+
+        if (is_candidate && relevance + bound_slack > threshold) {
+            collector.Push(make_document(document, relevance));
+            if (collector.IsFull()) {
+                threshold = collector.GetWorst().relevance - EPSILON;
+                while (first_essential < term_count && upper_bounds[first_essential + 1] + bound_slack <= threshold) {
+                    ++first_essential;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,245 @@
+#include "mutation_log.h"
+#include "index_snapshot.h"
+#include "mapped_file.h"
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+using namespace std;
+
+namespace {
+
+enum class MutationType : uint8_t {
+    ADD_DOCUMENT,
+    REMOVE_DOCUMENT,
+};
+
+// A record is the size and the checksum of its payload, then the payload
+const size_t RECORD_HEADER_SIZE = 2 * sizeof(uint32_t);
+
+// FNV-1a, enough to tell a record torn by a crash
+uint32_t ComputeChecksum(string_view data) {
+    uint32_t hash = 2166136261u;
+    for (const char c : data) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+    }
+    return hash;
+}
+
+string MakeHeader() {
+    BufferWriter header;
+    header.Write(MUTATION_LOG_MAGIC).Write(MUTATION_LOG_VERSION).Write(SNAPSHOT_BYTE_ORDER_MARK);
+    return header.GetData();
+}
+
+void SyncDescriptor(int fd, const string& path) {
+    if (fdatasync(fd) != 0) {
+        throw runtime_error("Can't sync "s + path + ": "s + strerror(errno));
+    }
+}
+
+void ApplyRecord(SearchServer& server, string_view payload) {
+    SnapshotReader reader(payload.data(), payload.size());
+    switch (reader.Read<MutationType>()) {
+        case MutationType::ADD_DOCUMENT: {
+            const int document_id = reader.Read<int>();
+            const auto status = reader.Read<DocumentStatus>();
+            const vector<int> ratings = reader.ReadArray<int>();
+            const string_view document = reader.ReadString();
+            if (static_cast<int>(status) < 0 || static_cast<int>(status) >= DOCUMENT_STATUS_COUNT) {
+                throw runtime_error("Mutation log is corrupted"s);
+            }
+            // Logged documents were valid, so only an id already present fails. That happens when
+            // a crash hit a checkpoint after the snapshot was saved: its records are replayed over it.
+            // Documents removed and added again later are brought up to date by the following records
+            try {
+                server.AddDocument(document_id, document, status, ratings);
+            } catch (const invalid_argument&) {
+            }
+            break;
+        }
+        case MutationType::REMOVE_DOCUMENT:
+            server.RemoveDocument(reader.Read<int>());
+            break;
+        default:
+            throw runtime_error("Mutation log is corrupted"s);
+    }
+}
+
+} // namespace
+
+MutationLog::MutationLog(const string& path, SearchServer& server)
+    : path_(path)
+    , fd_(open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644)) {
+    if (fd_ < 0) {
+        throw runtime_error("Can't open "s + path);
+    }
+    try {
+        Replay(server);
+        // New records follow the last complete one
+        if (ftruncate(fd_, file_size_) != 0) {
+            throw runtime_error("Can't truncate "s + path);
+        }
+        if (file_size_ == 0) {
+            WriteFile(MakeHeader());
+        }
+        SyncDescriptor(fd_, path_);
+    } catch (...) {
+        close(fd_);
+        throw;
+    }
+    writer_ = thread([this] {
+        WriteRecords();
+    });
+}
+
+MutationLog::~MutationLog() {
+    {
+        lock_guard guard(mutex_);
+        is_stopping_ = true;
+    }
+    records_queued_.notify_one();
+    writer_.join();
+    close(fd_);
+}
+
+uint64_t MutationLog::AppendAddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
+    BufferWriter payload;
+    payload.Write(MutationType::ADD_DOCUMENT).Write(document_id).Write(status).WriteArray(ratings).WriteString(document);
+    return AppendRecord(payload.GetData());
+}
+
+uint64_t MutationLog::AppendRemoveDocument(int document_id) {
+    BufferWriter payload;
+    payload.Write(MutationType::REMOVE_DOCUMENT).Write(document_id);
+    return AppendRecord(payload.GetData());
+}
+
+void MutationLog::WaitDurable(uint64_t sequence) const {
+    unique_lock lock(mutex_);
+    records_durable_.wait(lock, [&] {
+        return durable_count_ >= sequence || !error_.empty();
+    });
+    if (durable_count_ < sequence) {
+        throw runtime_error(error_);
+    }
+}
+
+void MutationLog::Flush() const {
+    uint64_t appended_count = 0;
+    {
+        lock_guard guard(mutex_);
+        appended_count = appended_count_;
+    }
+    WaitDurable(appended_count);
+}
+
+void MutationLog::Checkpoint(const SearchServer& server, const string& snapshot_path) {
+    // Queued records are in the server already, but must not be written after the log is emptied
+    Flush();
+    server.SaveSnapshot(snapshot_path);
+
+    lock_guard file_guard(file_mutex_);
+    if (ftruncate(fd_, 0) != 0) {
+        throw runtime_error("Can't truncate "s + path_);
+    }
+    file_size_ = 0;
+    WriteFile(MakeHeader());
+    SyncDescriptor(fd_, path_);
+}
+
+void MutationLog::Replay(SearchServer& server) {
+    const MappedFile file(path_);
+    const string_view contents = file.GetContents();
+    const string header = MakeHeader();
+    // A shorter file was torn while being created or emptied, the log starts over
+    if (contents.size() < header.size()) {
+        file_size_ = 0;
+        return;
+    }
+    if (contents.substr(0, header.size()) != header) {
+        throw runtime_error(path_ + " is not a compatible mutation log"s);
+    }
+    size_t position = header.size();
+    while (contents.size() - position >= RECORD_HEADER_SIZE) {
+        SnapshotReader record_header(contents.data() + position, RECORD_HEADER_SIZE);
+        const auto payload_size = record_header.Read<uint32_t>();
+        const auto checksum = record_header.Read<uint32_t>();
+        if (payload_size > contents.size() - position - RECORD_HEADER_SIZE) {
+            break;
+        }
+        const string_view payload = contents.substr(position + RECORD_HEADER_SIZE, payload_size);
+        if (ComputeChecksum(payload) != checksum) {
+            break;
+        }
+        ApplyRecord(server, payload);
+        position += RECORD_HEADER_SIZE + payload_size;
+        ++replayed_count_;
+    }
+    file_size_ = position;
+}
+
+uint64_t MutationLog::AppendRecord(const string& payload) {
+    const auto payload_size = static_cast<uint32_t>(payload.size());
+    const uint32_t checksum = ComputeChecksum(payload);
+    lock_guard guard(mutex_);
+    if (!error_.empty()) {
+        throw runtime_error(error_);
+    }
+    queued_records_.append(reinterpret_cast<const char*>(&payload_size), sizeof(payload_size));
+    queued_records_.append(reinterpret_cast<const char*>(&checksum), sizeof(checksum));
+    queued_records_ += payload;
+    records_queued_.notify_one();
+    return ++appended_count_;
+}
+
+void MutationLog::WriteRecords() {
+    string records;
+    unique_lock lock(mutex_);
+    while (true) {
+        records_queued_.wait(lock, [this] {
+            return is_stopping_ || !queued_records_.empty();
+        });
+        if (queued_records_.empty()) {
+            return;
+        }
+        // Records queued while the previous group was synced go to disk together
+        records.clear();
+        swap(records, queued_records_);
+        const uint64_t group_end = appended_count_;
+        lock.unlock();
+        string error;
+        try {
+            lock_guard file_guard(file_mutex_);
+            WriteFile(records);
+            SyncDescriptor(fd_, path_);
+        } catch (const exception& e) {
+            error = e.what();
+        }
+        lock.lock();
+        if (!error.empty()) {
+            error_ = move(error);
+            records_durable_.notify_all();
+            return;
+        }
+        durable_count_ = group_end;
+        records_durable_.notify_all();
+    }
+}
+
+void MutationLog::WriteFile(const string& data) {
+    size_t written_size = 0;
+    while (written_size < data.size()) {
+        const ssize_t written = pwrite(fd_, data.data() + written_size, data.size() - written_size, file_size_ + written_size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw runtime_error("Can't write "s + path_ + ": "s + strerror(errno));
+        }
+        written_size += written;
+    }
+    file_size_ += written_size;
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include "search_server.h"
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+const char MUTATION_LOG_MAGIC[8] = {'S', 'R', 'C', 'H', 'W', 'A', 'L', '\0'};
+const uint32_t MUTATION_LOG_VERSION = 1;
+
+// Append-only log of AddDocument and RemoveDocument. Appending only queues a record;
+// a writer thread writes queued records and syncs them to disk in groups, so many
+// modifications share one fdatasync. Together with snapshots it makes the index durable:
+//     SearchServer server = SearchServer::LoadSnapshot(snapshot_path); // or an empty server
+//     MutationLog log(log_path, server); // replays modifications made after the snapshot
+//     server.AddDocument(...); log.WaitDurable(log.AppendAddDocument(...));
+//     log.Checkpoint(server, snapshot_path); // the log starts over
+class MutationLog {
+public:
+    // Applies the records of the log at path to server, then appends to the log.
+    // A record torn by a crash ends the log and is dropped
+    MutationLog(const std::string& path, SearchServer& server);
+
+    MutationLog(const MutationLog&) = delete;
+    MutationLog& operator=(const MutationLog&) = delete;
+
+    // Writes and syncs the queued records
+    ~MutationLog();
+
+    // Records a modification already applied to the server, so failed ones aren't logged.
+    // Returns the sequence number of the record for WaitDurable
+    uint64_t AppendAddDocument(int document_id, std::string_view document, DocumentStatus status,
+                               const std::vector<int>& ratings);
+    uint64_t AppendRemoveDocument(int document_id);
+
+    // Waits until the record with the sequence number and all before it are on disk.
+    // Throws runtime_error if the log failed to be written
+    void WaitDurable(uint64_t sequence) const;
+
+    // Waits until every appended record is on disk
+    void Flush() const;
+
+    // Saves server to snapshot_path atomically and empties the log.
+    // The server must contain every logged modification and must not be modified meanwhile
+    void Checkpoint(const SearchServer& server, const std::string& snapshot_path);
+
+    size_t GetReplayedCount() const {
+        return replayed_count_;
+    }
+
+private:
+    std::string path_;
+    int fd_ = -1;
+    uint64_t file_size_ = 0;
+    size_t replayed_count_ = 0;
+
+    mutable std::mutex mutex_;
+    mutable std::condition_variable records_queued_;
+    mutable std::condition_variable records_durable_;
+    std::string queued_records_;
+    uint64_t appended_count_ = 0;
+    uint64_t durable_count_ = 0;
+    std::string error_; // the writer failed if not empty
+    bool is_stopping_ = false;
+    // Held while the file is written, so Checkpoint doesn't truncate under the writer
+    std::mutex file_mutex_;
+    std::thread writer_;
+
+    void Replay(SearchServer& server);
+    uint64_t AppendRecord(const std::string& payload);
+    void WriteRecords();
+    void WriteFile(const std::string& data);
+};
@@ -0,0 +1,27 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <numeric>
+#include <vector>
+
+// Calls function(i) for every i in [0, count) according to the policy. Exceptions can't leave
+// a parallel algorithm, so they are collected and the one of the smallest i is rethrown after all calls
+template <typename ExecutionPolicy, typename Function>
+void ForEachCollectingErrors(ExecutionPolicy&& policy, size_t count, Function function) {
+    std::vector<size_t> indexes(count);
+    std::iota(indexes.begin(), indexes.end(), 0);
+    std::vector<std::exception_ptr> errors(count);
+    std::for_each(policy, indexes.begin(), indexes.end(), [&](size_t i) {
+        try {
+            function(i);
+        } catch (...) {
+            errors[i] = std::current_exception();
+        }
+    });
+    for (const std::exception_ptr& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
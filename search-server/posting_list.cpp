@@ -0,0 +1,204 @@
+#include "posting_list.h"
+#include <cmath>
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+using namespace std;
+
+namespace {
+
+const size_t BLOCK_SIZE = PostingList::BLOCK_SIZE;
+
+uint8_t GetByteWidth(uint32_t max_value) {
+    return max_value <= UINT8_MAX ? 1 : max_value <= UINT16_MAX ? 2 : 4;
+}
+
+// Values are stored little-endian with width bytes each
+void EncodeValues(const uint32_t* values, uint8_t width, vector<uint8_t>& data) {
+    for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+        for (int byte = 0; byte < width; ++byte) {
+            data.push_back(static_cast<uint8_t>(values[i] >> (8 * byte)));
+        }
+    }
+}
+
+#ifdef __SSE2__
+// Loads 4 values widened to 32 bits
+template <int Width>
+__m128i LoadValues(const uint8_t* data) {
+    const __m128i zero = _mm_setzero_si128();
+    if constexpr (Width == 1) {
+        int32_t bytes;
+        memcpy(&bytes, data, sizeof(bytes));
+        return _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero), zero);
+    } else if constexpr (Width == 2) {
+        return _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(data)), zero);
+    } else {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+    }
+}
+
+// Document ids are restored from deltas by a prefix sum, 4 lanes at a time
+template <int Width>
+void DecodeDocumentIds(const uint8_t* data, int first_document_id, int* document_ids) {
+    __m128i previous = _mm_set1_epi32(first_document_id);
+    for (size_t i = 0; i < BLOCK_SIZE; i += 4) {
+        __m128i values = LoadValues<Width>(data + i * Width);
+        values = _mm_add_epi32(values, _mm_slli_si128(values, 4));
+        values = _mm_add_epi32(values, _mm_slli_si128(values, 8));
+        values = _mm_add_epi32(values, previous);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(document_ids + i), values);
+        previous = _mm_shuffle_epi32(values, _MM_SHUFFLE(3, 3, 3, 3));
+    }
+}
+
+template <int Width>
+void DecodeTermCounts(const uint8_t* data, uint32_t* term_counts) {
+    for (size_t i = 0; i < BLOCK_SIZE; i += 4) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(term_counts + i), LoadValues<Width>(data + i * Width));
+    }
+}
+#else
+template <int Width>
+uint32_t LoadValue(const uint8_t* data) {
+    uint32_t value = 0;
+    for (int byte = 0; byte < Width; ++byte) {
+        value |= static_cast<uint32_t>(data[byte]) << (8 * byte);
+    }
+    return value;
+}
+
+template <int Width>
+void DecodeDocumentIds(const uint8_t* data, int first_document_id, int* document_ids) {
+    int document_id = first_document_id;
+    for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+        document_id += static_cast<int>(LoadValue<Width>(data + i * Width));
+        document_ids[i] = document_id;
+    }
+}
+
+template <int Width>
+void DecodeTermCounts(const uint8_t* data, uint32_t* term_counts) {
+    for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+        term_counts[i] = LoadValue<Width>(data + i * Width);
+    }
+}
+#endif
+
+} // namespace
+
+void PostingList::Insert(int document_id, uint32_t term_count, double term_freq) {
+    if (tail_document_ids_.empty()) {
+        block_max_term_freqs_.push_back(term_freq);
+    } else {
+        block_max_term_freqs_.back() = max(block_max_term_freqs_.back(), term_freq);
+    }
+    max_term_freq_ = max(max_term_freq_, term_freq);
+    tail_document_ids_.push_back(document_id);
+    tail_term_counts_.push_back(term_count);
+    tail_term_freqs_.push_back(static_cast<float>(term_freq));
+    if (tail_document_ids_.size() == BLOCK_SIZE) {
+        EncodeTail();
+    }
+}
+
+void PostingList::Cursor::Seek(int document_id) {
+    if (IsEnd() || document_ids_[position_] >= document_id) {
+        return;
+    }
+    if (document_ids_[size_ - 1] < document_id) {
+        Load(postings_->FindBlock(block_ + 1, document_id));
+        if (IsEnd()) {
+            return;
+        }
+    }
+    position_ = lower_bound(document_ids_ + position_, document_ids_ + size_, document_id) - document_ids_;
+}
+
+void PostingList::Cursor::Load(size_t block) {
+    block_ = block;
+    position_ = 0;
+    size_ = block < postings_->GetBlockCount() ? postings_->DecodeBlock(block, document_ids_, term_counts_) : 0;
+}
+
+size_t PostingList::FindBlock(size_t first_block, int document_id) const {
+    size_t low = first_block;
+    size_t high = GetBlockCount();
+    while (low < high) {
+        const size_t middle = low + (high - low) / 2;
+        if (GetBlockLastId(middle) < document_id) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+size_t PostingList::DecodeBlock(size_t block, int* document_ids, uint32_t* term_counts) const {
+    if (block == blocks_.size()) {
+        copy(tail_document_ids_.begin(), tail_document_ids_.end(), document_ids);
+        copy(tail_term_counts_.begin(), tail_term_counts_.end(), term_counts);
+        return tail_document_ids_.size();
+    }
+    DecodeBlockIds(block, document_ids);
+    const Block& info = blocks_[block];
+    const uint8_t* const counts_data = data_.data() + info.offset + BLOCK_SIZE * info.id_width;
+    switch (info.count_width) {
+        case 1: DecodeTermCounts<1>(counts_data, term_counts); break;
+        case 2: DecodeTermCounts<2>(counts_data, term_counts); break;
+        default: DecodeTermCounts<4>(counts_data, term_counts); break;
+    }
+    return BLOCK_SIZE;
+}
+
+size_t PostingList::DecodeBlock(size_t block, int* document_ids, double* term_freqs) const {
+    if (block == blocks_.size()) {
+        copy(tail_document_ids_.begin(), tail_document_ids_.end(), document_ids);
+        copy(tail_term_freqs_.begin(), tail_term_freqs_.end(), term_freqs);
+        return tail_document_ids_.size();
+    }
+    DecodeBlockIds(block, document_ids);
+    const double step = block_max_term_freqs_[block] / IMPACT_LEVELS;
+    const uint16_t* const impacts = impacts_.data() + block * BLOCK_SIZE;
+    for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+        term_freqs[i] = impacts[i] * step;
+    }
+    return BLOCK_SIZE;
+}
+
+void PostingList::DecodeBlockIds(size_t block, int* document_ids) const {
+    const Block& info = blocks_[block];
+    const uint8_t* const ids_data = data_.data() + info.offset;
+    switch (info.id_width) {
+        case 1: DecodeDocumentIds<1>(ids_data, info.first_document_id, document_ids); break;
+        case 2: DecodeDocumentIds<2>(ids_data, info.first_document_id, document_ids); break;
+        default: DecodeDocumentIds<4>(ids_data, info.first_document_id, document_ids); break;
+    }
+}
+
+void PostingList::EncodeTail() {
+    // The first delta is zero, the block starts from its first id
+    uint32_t deltas[BLOCK_SIZE] = {0};
+    uint32_t max_delta = 0;
+    for (size_t i = 1; i < BLOCK_SIZE; ++i) {
+        deltas[i] = static_cast<uint32_t>(tail_document_ids_[i] - tail_document_ids_[i - 1]);
+        max_delta = max(max_delta, deltas[i]);
+    }
+    const uint32_t max_count = *max_element(tail_term_counts_.begin(), tail_term_counts_.end());
+
+    Block block{tail_document_ids_.front(), tail_document_ids_.back(), data_.size(),
+                GetByteWidth(max_delta), GetByteWidth(max_count)};
+    EncodeValues(deltas, block.id_width, data_);
+    EncodeValues(tail_term_counts_.data(), block.count_width, data_);
+    blocks_.push_back(block);
+    // The block maximum is final now, so the quantized frequencies never change
+    const double max_term_freq = block_max_term_freqs_.back();
+    for (const float term_freq : tail_term_freqs_) {
+        impacts_.push_back(static_cast<uint16_t>(lround(term_freq / max_term_freq * IMPACT_LEVELS)));
+    }
+    tail_document_ids_.clear();
+    tail_term_counts_.clear();
+    tail_term_freqs_.clear();
+}
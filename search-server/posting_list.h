@@ -0,0 +1,191 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Postings of a single term: document ids in ascending order with term counts.
+// Full blocks of BLOCK_SIZE postings are compressed: document ids are delta-encoded
+// and, like the counts, stored with the minimal byte width of the block (1, 2 or 4).
+// The last, incomplete block is kept uncompressed, so appending is cheap.
+// Term frequencies aren't stored: tf = count / words in the document, the caller
+// multiplies counts by the inverse document length, so scores are exact.
+// For quantized scoring blocks also keep term frequencies quantized to 16 bits
+// relative to the block maximum; the tail keeps them in single precision.
+class PostingList {
+public:
+    // Blocks also keep upper bounds of term frequency
+    static const size_t BLOCK_SIZE = 64;
+
+    // Quantized term frequencies are multiples of the block maximum divided by this
+    static const uint32_t IMPACT_LEVELS = UINT16_MAX;
+
+    // document_id must be greater than the present ones.
+    // term_freq is used for upper bounds and quantized term frequencies
+    void Insert(int document_id, uint32_t term_count, double term_freq);
+
+    double GetMaxTermFreq() const {
+        return max_term_freq_;
+    }
+
+    size_t size() const {
+        return blocks_.size() * BLOCK_SIZE + tail_document_ids_.size();
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    size_t GetBlockCount() const {
+        return block_max_term_freqs_.size();
+    }
+
+    // Calls function(document_id, term_count) for postings with ids in [begin_id, end_id)
+    template <typename Function>
+    void ForEach(int begin_id, int end_id, Function function) const;
+
+    // Calls function(document_id, term_count) for postings of blocks [first_block, end_block)
+    template <typename Function>
+    void ForEachInBlocks(size_t first_block, size_t end_block, Function function) const;
+
+    // Same, but call function(document_id, term_freq) with quantized term frequencies
+    template <typename Function>
+    void ForEachQuantized(int begin_id, int end_id, Function function) const;
+
+    template <typename Function>
+    void ForEachQuantizedInBlocks(size_t first_block, size_t end_block, Function function) const;
+
+    // Forward iteration with skipping, decodes one block at a time
+    class Cursor {
+    public:
+        explicit Cursor(const PostingList& postings)
+            : postings_(&postings) {
+            Load(0);
+        }
+
+        bool IsEnd() const {
+            return position_ == size_;
+        }
+
+        int GetDocumentId() const {
+            return document_ids_[position_];
+        }
+
+        uint32_t GetTermCount() const {
+            return term_counts_[position_];
+        }
+
+        double GetBlockMaxTermFreq() const {
+            return postings_->block_max_term_freqs_[block_];
+        }
+
+        void Next() {
+            if (++position_ == size_) {
+                Load(block_ + 1);
+            }
+        }
+
+        // Moves to the first posting with id not less than document_id, never backwards
+        void Seek(int document_id);
+
+    private:
+        const PostingList* postings_;
+        size_t block_ = 0;
+        size_t position_ = 0;
+        size_t size_ = 0;
+        int document_ids_[BLOCK_SIZE];
+        uint32_t term_counts_[BLOCK_SIZE];
+
+        void Load(size_t block);
+    };
+
+private:
+    struct Block {
+        int first_document_id;
+        int last_document_id;
+        size_t offset; // in data_
+        uint8_t id_width;
+        uint8_t count_width;
+    };
+
+    std::vector<Block> blocks_;
+    std::vector<uint8_t> data_;
+    std::vector<int> tail_document_ids_;
+    std::vector<uint32_t> tail_term_counts_;
+    std::vector<uint16_t> impacts_; // quantized term frequencies, BLOCK_SIZE per block
+    std::vector<float> tail_term_freqs_;
+    std::vector<double> block_max_term_freqs_; // the tail included
+    double max_term_freq_ = 0.0;
+
+    int GetBlockLastId(size_t block) const {
+        return block < blocks_.size() ? blocks_[block].last_document_id : tail_document_ids_.back();
+    }
+
+    // The first block not before first_block with the last id not less than document_id
+    size_t FindBlock(size_t first_block, int document_id) const;
+
+    // Return the number of postings in the block
+    size_t DecodeBlock(size_t block, int* document_ids, uint32_t* term_counts) const;
+    size_t DecodeBlock(size_t block, int* document_ids, double* term_freqs) const;
+
+    void DecodeBlockIds(size_t block, int* document_ids) const;
+
+    // Value is the type of the per-posting value DecodeBlock decodes
+    template <typename Value, typename Function>
+    void ForEachDecoded(int begin_id, int end_id, Function function) const;
+
+    template <typename Value, typename Function>
+    void ForEachDecodedInBlocks(size_t first_block, size_t end_block, Function function) const;
+
+    void EncodeTail();
+};
+
+template <typename Function>
+void PostingList::ForEach(int begin_id, int end_id, Function function) const {
+    ForEachDecoded<uint32_t>(begin_id, end_id, function);
+}
+
+template <typename Function>
+void PostingList::ForEachInBlocks(size_t first_block, size_t end_block, Function function) const {
+    ForEachDecodedInBlocks<uint32_t>(first_block, end_block, function);
+}
+
+template <typename Function>
+void PostingList::ForEachQuantized(int begin_id, int end_id, Function function) const {
+    ForEachDecoded<double>(begin_id, end_id, function);
+}
+
+template <typename Function>
+void PostingList::ForEachQuantizedInBlocks(size_t first_block, size_t end_block, Function function) const {
+    ForEachDecodedInBlocks<double>(first_block, end_block, function);
+}
+
+template <typename Value, typename Function>
+void PostingList::ForEachDecoded(int begin_id, int end_id, Function function) const {
+    int document_ids[BLOCK_SIZE];
+    Value values[BLOCK_SIZE];
+    for (size_t block = FindBlock(0, begin_id); block < GetBlockCount(); ++block) {
+        const size_t size = DecodeBlock(block, document_ids, values);
+        const int* const ids_end = document_ids + size;
+        const int* const first = std::lower_bound(static_cast<const int*>(document_ids), ids_end, begin_id);
+        const int* const last = std::lower_bound(first, ids_end, end_id);
+        for (const int* it = first; it != last; ++it) {
+            function(*it, values[it - document_ids]);
+        }
+        if (last != ids_end) {
+            break;
+        }
+    }
+}
+
+template <typename Value, typename Function>
+void PostingList::ForEachDecodedInBlocks(size_t first_block, size_t end_block, Function function) const {
+    int document_ids[BLOCK_SIZE];
+    Value values[BLOCK_SIZE];
+    for (size_t block = first_block; block < end_block; ++block) {
+        const size_t size = DecodeBlock(block, document_ids, values);
+        for (size_t i = 0; i < size; ++i) {
+            function(document_ids[i], values[i]);
+        }
+    }
+}
@@ -1,20 +1,110 @@
 #include "process_queries.h"
-#include <execution>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
 
 using namespace std;
 
 std::vector<Document> ProcessQueriesJoined(const SearchServer& search_server, const std::vector<std::string>& queries) {
-    std::vector<Document> all_search_results;
-    for(auto vec : ProcessQueries(search_server, queries))
-        all_search_results.insert(all_search_results.end(), vec.begin(), vec.end());
-    return all_search_results;
+    return search_server.FindTopDocumentsBatchJoined(queries);
 }
 
 vector<vector<Document>> ProcessQueries(const SearchServer& search_server, const vector<string>& queries) {
-    vector<vector<Document>> search_result(queries.size());
+    return search_server.FindTopDocumentsBatch(queries);
+}
+
+void ProcessQueriesJoined(const SearchServer& search_server, const vector<string>& queries,
+                          const function<void(size_t, const vector<Document>&)>& consumer, size_t window) {
+    if (window == 0) {
+        throw invalid_argument("Window must not be empty"s);
+    }
+    // The result of query i waits in slot i % window until it's consumed
+    struct Slot {
+        bool is_ready = false;
+        vector<Document> documents;
+        exception_ptr error;
+    };
+    vector<Slot> slots(min(window, queries.size()));
+    mutex slots_mutex;
+    condition_variable slot_ready;
+    condition_variable slot_free;
+    size_t consumed_count = 0;
+    bool is_stopped = false;
+    atomic<size_t> next_query = 0;
     
-    transform(std::execution::par, queries.begin(), queries.end(), search_result.begin(),
-              [&search_server](const string& query) {return search_server.FindTopDocuments(query);});
+    const auto search = [&] {
+        while (true) {
+            const size_t i = next_query.fetch_add(1);
+            if (i >= queries.size()) {
+                return;
+            }
+            {
+                unique_lock lock(slots_mutex);
+                slot_free.wait(lock, [&] {
+                    return is_stopped || i < consumed_count + slots.size();
+                });
+                if (is_stopped) {
+                    return;
+                }
+            }
+            // The slot isn't touched by the consumer until it's ready
+            Slot& slot = slots[i % slots.size()];
+            try {
+                slot.documents = search_server.FindTopDocuments(queries[i]);
+            } catch (...) {
+                slot.error = current_exception();
+            }
+            {
+                lock_guard lock(slots_mutex);
+                slot.is_ready = true;
+            }
+            slot_ready.notify_one();
+        }
+    };
     
-    return search_result;
-}
\ No newline at end of file
+    const size_t worker_count = min<size_t>(max(1u, thread::hardware_concurrency()), queries.size());
+    vector<thread> workers;
+    for (size_t i = 0; i < worker_count; ++i) {
+        workers.emplace_back(search);
+    }
+    const auto stop = [&] {
+        {
+            lock_guard lock(slots_mutex);
+            is_stopped = true;
+        }
+        slot_free.notify_all();
+        for (thread& worker : workers) {
+            worker.join();
+        }
+    };
+    
+    try {
+        for (size_t i = 0; i < queries.size(); ++i) {
+            Slot& slot = slots[i % slots.size()];
+            {
+                unique_lock lock(slots_mutex);
+                slot_ready.wait(lock, [&slot] {
+                    return slot.is_ready;
+                });
+            }
+            if (slot.error) {
+                rethrow_exception(slot.error);
+            }
+            consumer(i, slot.documents);
+            {
+                lock_guard lock(slots_mutex);
+                slot.is_ready = false;
+                ++consumed_count;
+            }
+            slot_free.notify_all();
+        }
+    } catch (...) {
+        stop();
+        throw;
+    }
+    stop();
+}
@@ -1,8 +1,18 @@
 #pragma once
 #include <execution>
+#include <functional>
 #include "search_server.h"
 
 std::vector<std::vector<Document>> ProcessQueries(const SearchServer& search_server,
         const std::vector<std::string>& queries);
 
-std::vector<Document> ProcessQueriesJoined(const SearchServer& search_server, const std::vector<std::string>& queries);
\ No newline at end of file
+std::vector<Document> ProcessQueriesJoined(const SearchServer& search_server, const std::vector<std::string>& queries);
+
+// Streaming variant: calls consumer(query_index, documents) on the calling thread for every query
+// in the order of queries, as soon as the query and all the previous ones are done.
+// Searches run on worker threads at most window queries ahead of the consumer,
+// so memory doesn't grow with the number of queries and a slow consumer holds the workers back.
+// An exception of a query or of the consumer stops the workers and is rethrown
+void ProcessQueriesJoined(const SearchServer& search_server, const std::vector<std::string>& queries,
+                          const std::function<void(size_t, const std::vector<Document>&)>& consumer,
+                          size_t window = 1024);
@@ -0,0 +1,69 @@
+#include "query_cache.h"
+#include <functional>
+#include <stdexcept>
+using namespace std;
+
+QueryCache::QueryCache(size_t capacity, size_t shard_count)
+    : shards_(shard_count) {
+    if (shard_count == 0) {
+        throw invalid_argument("Query cache needs at least one shard"s);
+    }
+    shard_capacity_ = (capacity + shard_count - 1) / shard_count;
+}
+
+optional<vector<Document>> QueryCache::Find(string_view key, uint64_t generation) {
+    Shard& shard = GetShard(key);
+    lock_guard guard(shard.mutex);
+    const auto it = shard.positions.find(key);
+    if (it == shard.positions.end()) {
+        ++shard.stats.miss_count;
+        return nullopt;
+    }
+    const auto entry = it->second;
+    if (entry->generation != generation) {
+        // Computed for another version of the index, it will never be valid again
+        shard.positions.erase(it);
+        shard.entries.erase(entry);
+        ++shard.stats.miss_count;
+        return nullopt;
+    }
+    shard.entries.splice(shard.entries.begin(), shard.entries, entry);
+    ++shard.stats.hit_count;
+    return entry->documents;
+}
+
+void QueryCache::Insert(string_view key, uint64_t generation, const vector<Document>& documents) {
+    if (shard_capacity_ == 0) {
+        return;
+    }
+    Shard& shard = GetShard(key);
+    lock_guard guard(shard.mutex);
+    // The query could have been computed concurrently by another thread
+    const auto it = shard.positions.find(key);
+    if (it != shard.positions.end()) {
+        it->second->generation = generation;
+        it->second->documents = documents;
+        shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+        return;
+    }
+    if (shard.entries.size() == shard_capacity_) {
+        shard.positions.erase(shard.entries.back().key);
+        shard.entries.pop_back();
+    }
+    shard.entries.push_front({string(key), generation, documents});
+    shard.positions.emplace(shard.entries.front().key, shard.entries.begin());
+}
+
+QueryCacheStats QueryCache::GetStats() const {
+    QueryCacheStats stats;
+    for (const Shard& shard : shards_) {
+        lock_guard guard(shard.mutex);
+        stats.hit_count += shard.stats.hit_count;
+        stats.miss_count += shard.stats.miss_count;
+    }
+    return stats;
+}
+
+QueryCache::Shard& QueryCache::GetShard(string_view key) {
+    return shards_[hash<string_view>{}(key) % shards_.size()];
+}
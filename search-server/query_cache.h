@@ -0,0 +1,52 @@
+#pragma once
+#include "document.h"
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+struct QueryCacheStats {
+    uint64_t hit_count = 0;
+    uint64_t miss_count = 0;
+};
+
+// Bounded LRU cache of search results, split into independently locked shards by key hash.
+// Every entry remembers the index generation it was computed for, entries of other
+// generations count as absent, so a modification of the index invalidates the cache in O(1)
+class QueryCache {
+public:
+    static const size_t DEFAULT_SHARD_COUNT = 16;
+
+    explicit QueryCache(size_t capacity, size_t shard_count = DEFAULT_SHARD_COUNT);
+
+    // Counts a hit or a miss. Safe to call concurrently
+    std::optional<std::vector<Document>> Find(std::string_view key, uint64_t generation);
+
+    void Insert(std::string_view key, uint64_t generation, const std::vector<Document>& documents);
+
+    QueryCacheStats GetStats() const;
+
+private:
+    struct Entry {
+        std::string key;
+        uint64_t generation;
+        std::vector<Document> documents;
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::list<Entry> entries; // the most recently used first
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> positions; // keys refer to entries
+        QueryCacheStats stats;
+    };
+
+    size_t shard_capacity_;
+    std::vector<Shard> shards_;
+
+    Shard& GetShard(std::string_view key);
+};
@@ -1,40 +1,212 @@
 #include "read_input_functions.h"
+#include "mapped_file.h"
+#include <charconv>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <execution>
 #include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
 #include <vector>
+using namespace std;
 
-template<typename It>
-class IteratorRange {
-public:
-    It begin() const {
-        return begin_;
+string ReadLine() {
+    string s;
+    getline(cin, s);
+    return s;
+}
+
+int ReadLineWithNumber() {
+    int result;
+    cin >> result;
+    ReadLine();
+    return result;
+}
+
+namespace {
+
+// Batches parsed ahead of indexing; more would only hold memory
+const size_t CORPUS_QUEUE_CAPACITY = 2;
+
+struct CorpusBatch {
+    vector<RawDocument> documents; // texts are views into the mapped file
+    vector<size_t> line_numbers; // of the documents
+    exception_ptr error; // the batch ends at a malformed line if set
+};
+
+invalid_argument MakeLineError(const string& path, size_t line_number, const char* message) {
+    return invalid_argument(path + ":"s + to_string(line_number) + ": "s + message);
+}
+
+// Cuts the field before the next tab off the line
+string_view CutField(string_view& line) {
+    const size_t tab = line.find('\t');
+    if (tab == string_view::npos) {
+        throw invalid_argument("Too few fields"s);
     }
-    
-    It end() const {
-        return end_;
+    const string_view field = line.substr(0, tab);
+    line.remove_prefix(tab + 1);
+    return field;
+}
+
+int ParseNumber(string_view text) {
+    int value = 0;
+    const auto [end, error] = from_chars(text.data(), text.data() + text.size(), value);
+    if (text.empty() || error != errc() || end != text.data() + text.size()) {
+        throw invalid_argument("Invalid number "s + string(text));
     }
-    
-    void SetBegin(It iter){
-        begin_ = iter;
+    return value;
+}
+
+DocumentStatus ParseStatus(string_view text) {
+    static const string_view names[DOCUMENT_STATUS_COUNT] = {"ACTUAL"sv, "IRRELEVANT"sv, "BANNED"sv, "REMOVED"sv};
+    for (int status = 0; status < DOCUMENT_STATUS_COUNT; ++status) {
+        if (text == names[status]) {
+            return static_cast<DocumentStatus>(status);
+        }
     }
-    
-    void SetEnd(It iter){
-        end_ = iter;
+    throw invalid_argument("Invalid status "s + string(text));
+}
+
+RawDocument ParseCorpusLine(string_view line) {
+    RawDocument document;
+    document.id = ParseNumber(CutField(line));
+    document.status = ParseStatus(CutField(line));
+    string_view ratings = CutField(line);
+    while (!ratings.empty()) {
+        const size_t space = ratings.find(' ');
+        const string_view rating = ratings.substr(0, space);
+        if (!rating.empty()) {
+            document.ratings.push_back(ParseNumber(rating));
+        }
+        ratings.remove_prefix(space == string_view::npos ? ratings.size() : space + 1);
     }
-    
-    int size() const {
-        return distance(begin_, end_);
+    document.text = line;
+    return document;
+}
+
+// Nothing of a batch rejected by AddDocuments is added. Its documents are added one by one
+// up to the rejected one, which is reported with its line
+void AddDocumentsUntilRejected(SearchServer& server, const string& path, const CorpusBatch& batch) {
+    for (size_t i = 0; i < batch.documents.size(); ++i) {
+        const RawDocument& document = batch.documents[i];
+        try {
+            server.AddDocument(document.id, document.text, document.status, document.ratings);
+        } catch (const invalid_argument& e) {
+            throw MakeLineError(path, batch.line_numbers[i], e.what());
+        }
     }
-private:
-    It begin_;
-    It end_;
-};
+}
+
+} // namespace
+
+size_t LoadCorpus(SearchServer& server, const string& path, size_t batch_size) {
+    if (batch_size == 0) {
+        throw invalid_argument("Batch must not be empty"s);
+    }
+    const MappedFile file(path);
+    file.AdviseSequential();
+    const string_view contents = file.GetContents();
+
+    deque<CorpusBatch> queue;
+    mutex queue_mutex;
+    condition_variable batch_ready;
+    condition_variable batch_taken;
+    bool is_parsed = false;
+    bool is_stopped = false;
+
+    thread parser([&] {
+        size_t position = 0;
+        size_t line_number = 0;
+        while (position < contents.size()) {
+            CorpusBatch batch;
+            batch.documents.reserve(batch_size);
+            try {
+                while (batch.documents.size() < batch_size && position < contents.size()) {
+                    size_t line_end = contents.find('\n', position);
+                    if (line_end == string_view::npos) {
+                        line_end = contents.size();
+                    }
+                    string_view line = contents.substr(position, line_end - position);
+                    position = line_end + 1;
+                    ++line_number;
+                    if (!line.empty() && line.back() == '\r') {
+                        line.remove_suffix(1);
+                    }
+                    if (line.empty()) {
+                        continue;
+                    }
+                    try {
+                        batch.documents.push_back(ParseCorpusLine(line));
+                    } catch (const invalid_argument& e) {
+                        throw MakeLineError(path, line_number, e.what());
+                    }
+                    batch.line_numbers.push_back(line_number);
+                }
+            } catch (...) {
+                batch.error = current_exception();
+            }
+            const bool is_malformed = static_cast<bool>(batch.error);
+            {
+                unique_lock lock(queue_mutex);
+                batch_taken.wait(lock, [&] {
+                    return is_stopped || queue.size() < CORPUS_QUEUE_CAPACITY;
+                });
+                if (is_stopped) {
+                    return;
+                }
+                queue.push_back(move(batch));
+            }
+            batch_ready.notify_one();
+            if (is_malformed) {
+                break;
+            }
+        }
+        {
+            lock_guard guard(queue_mutex);
+            is_parsed = true;
+        }
+        batch_ready.notify_one();
+    });
 
-template<typename It>
-std::ostream& operator<< (std::ostream &out, const IteratorRange<It> &range)
-{
-    for(It i = range.begin(); i != range.end(); ++i){
-        auto temp = *i;
-        out << temp;
+    size_t document_count = 0;
+    try {
+        while (true) {
+            CorpusBatch batch;
+            {
+                unique_lock lock(queue_mutex);
+                batch_ready.wait(lock, [&] {
+                    return is_parsed || !queue.empty();
+                });
+                if (queue.empty()) {
+                    break;
+                }
+                batch = move(queue.front());
+                queue.pop_front();
+            }
+            batch_taken.notify_one();
+            // The documents before the malformed line are added too
+            try {
+                server.AddDocuments(execution::par, batch.documents);
+            } catch (const invalid_argument&) {
+                AddDocumentsUntilRejected(server, path, batch);
+            }
+            document_count += batch.documents.size();
+            if (batch.error) {
+                rethrow_exception(batch.error);
+            }
+        }
+    } catch (...) {
+        {
+            lock_guard guard(queue_mutex);
+            is_stopped = true;
+        }
+        batch_taken.notify_one();
+        parser.join();
+        throw;
     }
-    return out;
-}
\ No newline at end of file
+    parser.join();
+    return document_count;
+}
@@ -1,6 +1,18 @@
 #pragma once
+#include "search_server.h"
 #include <string>
 
 std::string ReadLine();
 
-int ReadLineWithNumber();
\ No newline at end of file
+int ReadLineWithNumber();
+
+const size_t CORPUS_BATCH_SIZE = 4096;
+
+// Adds the documents of a corpus file to server and returns their number. Every line is
+//     id<TAB>status<TAB>ratings<TAB>text
+// where status is a DocumentStatus name (ACTUAL, IRRELEVANT, BANNED, REMOVED) and ratings
+// are separated by spaces, possibly none; empty lines are skipped. The file is memory-mapped
+// and parsed on a separate thread while the previous batch is indexed by AddDocuments.
+// A malformed line or a document rejected by the server, e.g. for a duplicate id, throws
+// invalid_argument with the file and line; the documents before that line stay added
+size_t LoadCorpus(SearchServer& server, const std::string& path, size_t batch_size = CORPUS_BATCH_SIZE);
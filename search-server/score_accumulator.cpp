@@ -0,0 +1,22 @@
+#include "score_accumulator.h"
+using namespace std;
+
+void ScoreAccumulator::Prepare(size_t index_count) {
+    if (scores_.size() < index_count) {
+        scores_.resize(index_count, 0.0);
+        flags_.resize(index_count, 0);
+    }
+}
+
+void ScoreAccumulator::Reset() {
+    for (const int index : touched_) {
+        scores_[index] = 0.0;
+        flags_[index] = 0;
+    }
+    touched_.clear();
+}
+
+ScoreAccumulator& GetThreadScoreAccumulator() {
+    thread_local ScoreAccumulator accumulator;
+    return accumulator;
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Relevance accumulator over dense internal document indexes.
+// Touched indexes are remembered, so Reset() costs O(touched) and the
+// buffers can be reused between queries without reallocation.
+class ScoreAccumulator {
+public:
+    // Grows the buffers to hold index_count documents
+    void Prepare(size_t index_count);
+
+    // Excluded documents are never scored; exclusions must precede additions
+    void Exclude(int index) {
+        uint8_t& flags = flags_[index];
+        if (!(flags & LISTED)) {
+            flags |= LISTED;
+            touched_.push_back(index);
+        }
+        flags |= EXCLUDED;
+    }
+
+    bool IsExcluded(int index) const {
+        return flags_[index] & EXCLUDED;
+    }
+
+    // The document must not be excluded
+    void Add(int index, double value) {
+        uint8_t& flags = flags_[index];
+        if (!(flags & LISTED)) {
+            flags |= LISTED;
+            touched_.push_back(index);
+        }
+        flags |= SCORED;
+        scores_[index] += value;
+    }
+
+    template <typename Function>
+    void ForEachScored(Function function) const {
+        for (const int index : touched_) {
+            if ((flags_[index] & (SCORED | EXCLUDED)) == SCORED) {
+                function(index, scores_[index]);
+            }
+        }
+    }
+
+    void Reset();
+
+private:
+    enum Flags : uint8_t {
+        SCORED = 1,
+        LISTED = 2,
+        EXCLUDED = 4,
+    };
+
+    std::vector<double> scores_;
+    std::vector<uint8_t> flags_;
+    std::vector<int> touched_;
+};
+
+// Accumulator reused by all queries running on the calling thread
+ScoreAccumulator& GetThreadScoreAccumulator();
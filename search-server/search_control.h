@@ -0,0 +1,39 @@
+#pragma once
+#include "document.h"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+// Cooperative cancellation: copies share the flag, so the caller keeps one copy
+// and cancels a search which has got another
+class CancellationToken {
+public:
+    void Cancel() const {
+        is_cancelled_->store(true, std::memory_order_relaxed);
+    }
+
+    bool IsCancelled() const {
+        return is_cancelled_->load(std::memory_order_relaxed);
+    }
+
+private:
+    std::shared_ptr<std::atomic<bool>> is_cancelled_ = std::make_shared<std::atomic<bool>>(false);
+};
+
+// Limits of a search, checked periodically while postings are scanned
+struct SearchControl {
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+    CancellationToken token;
+
+    bool ShouldStop() const {
+        return token.IsCancelled() || std::chrono::steady_clock::now() >= deadline;
+    }
+};
+
+struct SearchResult {
+    std::vector<Document> documents;
+    // The search was stopped: documents are the best of the part of the index scanned so far,
+    // with exact relevance
+    bool is_partial = false;
+};
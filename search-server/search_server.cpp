@@ -1,6 +1,11 @@
 #include "search_server.h"
 #include "process_queries.h"
+#include "index_snapshot.h"
+#include <array>
+#include <exception>
 #include <execution>
+#include <functional>
+#include <numeric>
 #include <string>
 #include <vector>
 #include <set>
@@ -8,36 +13,94 @@
 using namespace std;
 
 void SearchServer::AddDocument(int document_id, const string_view document, DocumentStatus status, const vector<int>& ratings) {
-    if ((document_id < 0) || (documents_.count(document_id) > 0))
+    if ((document_id < 0) || (document_indexes_.count(document_id) > 0))
         throw invalid_argument("Invalid document_id"s);
-    storage.emplace_back(document);
-    const auto words = SplitIntoWordsNoStop(storage.back());
+    vector<string_view> words;
+    SplitIntoWordsNoStop(document, words);
     
+    const int index = static_cast<int>(documents_.size());
     const double inv_word_count = 1.0 / words.size();
+    map<string_view, uint32_t> document_word_counts; // views into document
     for (const string_view word : words)
-        word_to_document_freqs_[word][document_id] += inv_word_count;
-    for (const string_view word : words) {
-        SearchServer::id_to_w_freqs_[document_id].insert({word, word_to_document_freqs_[word][document_id]});
+        ++document_word_counts[word];
+    // The document text isn't kept, new terms are interned
+    vector<pair<int, uint32_t>> term_counts;
+    term_counts.reserve(document_word_counts.size());
+    for (const auto [word, term_count] : document_word_counts) {
+        auto it = term_ids_.find(word);
+        if (it == term_ids_.end()) {
+            it = term_ids_.emplace(term_pool_.Add(word), static_cast<int>(postings_.size())).first;
+            words_.push_back(it->first);
+            postings_.emplace_back();
+        }
+        postings_[it->second].Insert(index, status, term_count, term_count * inv_word_count);
+        term_counts.emplace_back(it->second, term_count);
+    }
+    sort(term_counts.begin(), term_counts.end());
+    for (const auto& [term_id, term_count] : term_counts) {
+        forward_term_ids_.push_back(term_id);
+        forward_term_counts_.push_back(term_count);
     }
-    documents_.emplace(document_id, DocumentData{ComputeAverageRating(ratings), status});
+    forward_offsets_.push_back(forward_term_ids_.size());
+    documents_.push_back(DocumentData{document_id, ComputeAverageRating(ratings), status, inv_word_count});
+    document_indexes_.emplace(document_id, index);
     all_ids_.insert(document_id);
+    ++generation_;
+}
+
+void SearchServer::AddDocuments(const vector<RawDocument>& documents) {
+    AddDocuments(execution::seq, documents);
 }
 
 void SearchServer::RemoveDocument(int document_id) {
-    if (!all_ids_.count(document_id))
-        return;
-    set<string_view> this_doc_words;
-    for (auto [key, value] : GetWordFrequencies(document_id))
-        word_to_document_freqs_.at(key).erase(document_id);
-    id_to_w_freqs_.erase(document_id);
-    documents_.erase(document_id);
-    all_ids_.erase(document_id);
+    RemoveDocument(execution::seq, document_id);
+}
+
+vector<Document> SearchServer::FindTopDocuments(const string_view raw_query, DocumentStatus status, size_t top_k) const {
+    QueryContext& context = GetThreadQueryContext();
+    ParseQuery(raw_query, context, true);
+    return FindCachedDocuments(context, status, top_k, [&] {
+        return SearchResult{FindAllDocuments(context, MakeStatusMask(status), AcceptAll{}, top_k)};
+    }).documents;
 }
 
-vector<Document> SearchServer::FindTopDocuments(const string_view raw_query, DocumentStatus status) const {
-    return FindTopDocuments(raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-            return document_status == status;
+SearchResult SearchServer::FindTopDocuments(const string_view raw_query, DocumentStatus status, const SearchControl& control, size_t top_k) const {
+    QueryContext& context = GetThreadQueryContext();
+    ParseQuery(raw_query, context, true);
+    return FindCachedDocuments(context, status, top_k, [&] {
+        ResolveQuery(context, MakeStatusMask(status));
+        SearchResult result;
+        result.documents = FindResolvedDocuments(context, AcceptAll{}, top_k, [&] {
+            return result.is_partial = control.ShouldStop();
         });
+        return result;
+    });
+}
+
+vector<Document> SearchServer::FindTopDocuments(const string_view raw_query, DocumentStatus status, const QueryStatistics& statistics,
+                                                size_t top_k) const {
+    QueryContext& context = GetThreadQueryContext();
+    ParseQuery(raw_query, context, true);
+    ResolveQuery(context, MakeStatusMask(status), &statistics);
+    return FindResolvedDocuments(context, AcceptAll{}, top_k);
+}
+
+QueryStatistics SearchServer::GetQueryStatistics(const string_view raw_query) const {
+    QueryContext& context = GetThreadQueryContext();
+    ParseQuery(raw_query, context, true);
+    QueryStatistics statistics;
+    statistics.document_count = GetDocumentCount();
+    for (const string_view word : context.query.plus_words) {
+        const int term_id = FindTermId(word);
+        statistics.document_freqs.push_back(term_id >= 0 ? postings_[term_id].document_freq : 0);
+    }
+    return statistics;
+}
+
+future<SearchResult> SearchServer::FindTopDocumentsAsync(string raw_query, DocumentStatus status, SearchControl control, size_t top_k) const {
+    return async(launch::async, [this, raw_query = move(raw_query), status, control = move(control), top_k] {
+        return FindTopDocuments(raw_query, status, control, top_k);
+    });
 }
 
 vector<Document> SearchServer::FindTopDocuments(const string_view raw_query) const {
@@ -45,45 +108,399 @@ vector<Document> SearchServer::FindTopDocuments(const string_view raw_query) con
 }
 
 int SearchServer::GetDocumentCount() const {
-    return static_cast<int>(documents_.size());
+    return static_cast<int>(document_indexes_.size());
+}
+
+void SearchServer::SetScoringMode(ScoringMode mode) {
+    scoring_mode_ = mode;
+    ++generation_;
+}
+
+void SearchServer::EnableQueryCache(size_t capacity) {
+    query_cache_ = make_unique<QueryCache>(capacity);
+}
+
+QueryCacheStats SearchServer::GetQueryCacheStats() const {
+    return query_cache_ ? query_cache_->GetStats() : QueryCacheStats{};
 }
 
 tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const string_view raw_query, int document_id) const {
-    auto query = ParseQuery(raw_query);
+    const int index = document_indexes_.at(document_id);
+    QueryContext& context = GetThreadQueryContext();
+    ParseQuery(raw_query, context, true);
+    const Query& query = context.query;
     vector<string_view> matched_words;
     
-    std::sort(query.minus_words.begin(), query.minus_words.end());
-    auto iter1 = std::unique(query.minus_words.begin(), query.minus_words.end());
-    query.minus_words.erase(iter1, query.minus_words.end());
-
-    std::sort(query.plus_words.begin(), query.plus_words.end());
-    auto iter2 = std::unique(query.plus_words.begin(), query.plus_words.end());
-    query.plus_words.erase(iter2, query.plus_words.end());
-    
     for (const string_view word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) && word_to_document_freqs_.at(word).count(document_id))
-            return {matched_words, documents_.at(document_id).status};
+        if (HasWord(word, index))
+            return {matched_words, documents_[index].status};
     }
     
     for (string_view word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) && word_to_document_freqs_.at(word).count(document_id))
+        if (HasWord(word, index))
             matched_words.push_back(word);
     }
     
-    return {matched_words, documents_.at(document_id).status};
+    return {matched_words, documents_[index].status};
+}
+
+vector<vector<Document>> SearchServer::FindTopDocumentsBatch(const vector<string>& queries, DocumentStatus status, size_t top_k) const {
+    vector<vector<Document>> results(queries.size());
+    RunTopDocumentsBatch(queries, status, top_k, [&results](size_t i, vector<Document>&& documents) {
+        results[i] = move(documents);
+    });
+    return results;
+}
+
+vector<Document> SearchServer::FindTopDocumentsBatchJoined(const vector<string>& queries, DocumentStatus status, size_t top_k) const {
+    // No query finds more than this, so every query writes into its own slot of this size
+    const size_t slot_size = min(top_k, static_cast<size_t>(GetDocumentCount()));
+    vector<Document> joined(queries.size() * slot_size);
+    vector<size_t> sizes(queries.size());
+    RunTopDocumentsBatch(queries, status, top_k, [&](size_t i, vector<Document>&& documents) {
+        copy(documents.begin(), documents.end(), joined.begin() + i * slot_size);
+        sizes[i] = documents.size();
+    });
+    // The gaps of slots not filled up are closed, documents only move towards the front
+    size_t joined_size = 0;
+    for (size_t i = 0; i < queries.size(); ++i) {
+        const auto slot = joined.begin() + i * slot_size;
+        if (joined.begin() + joined_size != slot) {
+            copy(slot, slot + sizes[i], joined.begin() + joined_size);
+        }
+        joined_size += sizes[i];
+    }
+    joined.resize(joined_size);
+    return joined;
+}
+
+template <typename ResultStore>
+void SearchServer::RunTopDocumentsBatch(const vector<string>& queries, DocumentStatus status, size_t top_k, ResultStore store) const {
+    const size_t query_count = queries.size();
+    vector<Query> parsed(query_count);
+    ForEachCollectingErrors(execution::par, query_count, [&](size_t i) {
+        QueryContext& context = GetThreadQueryContext();
+        ParseQuery(queries[i], context, true);
+        parsed[i] = context.query;
+    });
+    
+    // Every distinct word of the batch is looked up in the dictionary and gets its idf once
+    vector<string_view> words;
+    for (const Query& query : parsed) {
+        words.insert(words.end(), query.plus_words.begin(), query.plus_words.end());
+        words.insert(words.end(), query.minus_words.begin(), query.minus_words.end());
+    }
+    sort(words.begin(), words.end());
+    words.erase(unique(words.begin(), words.end()), words.end());
+    
+    struct ResolvedWord {
+        int term_id;
+        double inverse_document_freq;
+        size_t posting_count; // with the requested status
+    };
+    const StatusMask statuses = MakeStatusMask(status);
+    const double log_document_count = log(GetDocumentCount());
+    vector<ResolvedWord> resolved(words.size(), {-1, 0.0, 0});
+    for (size_t i = 0; i < words.size(); ++i) {
+        const int term_id = FindTermId(words[i]);
+        resolved[i].term_id = term_id;
+        if (term_id >= 0 && postings_[term_id].document_freq > 0) {
+            resolved[i].inverse_document_freq = ComputeWordInverseDocumentFreq(term_id, log_document_count);
+            resolved[i].posting_count = postings_[term_id].by_status[static_cast<int>(status)].size();
+        }
+    }
+    const auto resolve = [&](string_view word) -> const ResolvedWord& {
+        return resolved[lower_bound(words.begin(), words.end(), word) - words.begin()];
+    };
+    
+    // The most expensive queries are started first, so they don't end up last on one thread
+    // while the others are idle; the parallel algorithm balances the rest by work stealing
+    vector<size_t> costs(query_count, 0);
+    for (size_t i = 0; i < query_count; ++i) {
+        for (const string_view word : parsed[i].plus_words) {
+            costs[i] += resolve(word).posting_count;
+        }
+    }
+    vector<size_t> query_indexes(query_count);
+    iota(query_indexes.begin(), query_indexes.end(), 0);
+    stable_sort(query_indexes.begin(), query_indexes.end(), [&costs](size_t lhs, size_t rhs) {
+        return costs[lhs] > costs[rhs];
+    });
+    
+    for_each(execution::par, query_indexes.begin(), query_indexes.end(), [&](size_t i) {
+        QueryContext& context = GetThreadQueryContext();
+        context.query = parsed[i];
+        store(i, FindCachedDocuments(context, status, top_k, [&] {
+            context.terms.clear();
+            for (const string_view word : context.query.plus_words) {
+                const ResolvedWord& word_info = resolve(word);
+                if (word_info.posting_count > 0) {
+                    AppendPlusTerm(word_info.term_id, word_info.inverse_document_freq, statuses, context.terms);
+                }
+            }
+            context.excluded.clear();
+            for (const string_view word : context.query.minus_words) {
+                const ResolvedWord& word_info = resolve(word);
+                if (word_info.term_id >= 0) {
+                    AppendMinusTerm(word_info.term_id, statuses, context.excluded);
+                }
+            }
+            return SearchResult{FindResolvedDocuments(context, AcceptAll{}, top_k)};
+        }).documents);
+    });
+}
+
+WordFrequencies SearchServer::GetWordFrequencies(int document_id) const {
+    const auto it = document_indexes_.find(document_id);
+    if (it == document_indexes_.end())
+        return {};
+    return GetForwardIndex(it->second);
 }
 
-const map<string_view, double>& SearchServer::GetWordFrequencies(int document_id) const {
-    static map<string_view, double> empty_map;
-    if(all_ids_.count(document_id))
-        return SearchServer::id_to_w_freqs_.at(document_id);
-    return empty_map;
+void SearchServer::SaveSnapshot(const string& path) const {
+    SnapshotWriter writer(path);
+    writer.Write(SNAPSHOT_MAGIC);
+    writer.Write(SNAPSHOT_VERSION);
+    writer.Write(SNAPSHOT_BYTE_ORDER_MARK);
+    
+    writer.Write(static_cast<uint32_t>(stop_words_.size()));
+    for (const string& word : stop_words_) {
+        writer.WriteString(word);
+    }
+    
+    writer.Write(static_cast<uint32_t>(words_.size()));
+    for (const string_view word : words_) {
+        writer.WriteString(word);
+    }
+    
+    // Removed documents which aren't purged yet keep their slots, so postings can be saved as they are
+    vector<int> ids, ratings, statuses;
+    vector<double> inv_word_counts;
+    for (const DocumentData& document_data : documents_) {
+        ids.push_back(document_data.id);
+        ratings.push_back(document_data.rating);
+        statuses.push_back(static_cast<int>(document_data.status));
+        inv_word_counts.push_back(document_data.inv_word_count);
+    }
+    vector<uint8_t> is_present(documents_.size(), 0);
+    for (const auto [document_id, index] : document_indexes_) {
+        is_present[index] = 1;
+    }
+    writer.WriteArray(ids);
+    writer.WriteArray(ratings);
+    writer.WriteArray(statuses);
+    writer.WriteArray(inv_word_counts);
+    writer.WriteArray(is_present);
+    
+    // Postings are stored decoded, so the format doesn't depend on the block layout
+    vector<int> indexes;
+    vector<uint32_t> term_counts;
+    for (const TermPostings& term_postings : postings_) {
+        for (const PostingList& postings : term_postings.by_status) {
+            indexes.clear();
+            term_counts.clear();
+            postings.ForEachInBlocks(0, postings.GetBlockCount(), [&](int index, uint32_t term_count) {
+                indexes.push_back(index);
+                term_counts.push_back(term_count);
+            });
+            writer.WriteArray(indexes);
+            writer.WriteArray(term_counts);
+        }
+    }
+    writer.Finish();
+}
+
+SearchServer SearchServer::LoadSnapshot(const string& path) {
+    auto file = make_shared<const MappedFile>(path);
+    SnapshotReader reader(file->data(), file->size());
+    const auto magic = reader.Read<array<char, sizeof(SNAPSHOT_MAGIC)>>();
+    if (memcmp(magic.data(), SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0
+        || reader.Read<uint32_t>() != SNAPSHOT_VERSION
+        || reader.Read<uint32_t>() != SNAPSHOT_BYTE_ORDER_MARK) {
+        throw runtime_error(path + " is not a compatible index snapshot"s);
+    }
+    
+    vector<string_view> stop_words(reader.Read<uint32_t>());
+    for (string_view& word : stop_words) {
+        word = reader.ReadString();
+    }
+    SearchServer server(stop_words);
+    server.snapshot_file_ = file;
+    
+    const uint32_t term_count = reader.Read<uint32_t>();
+    server.words_.resize(term_count);
+    for (uint32_t term_id = 0; term_id < term_count; ++term_id) {
+        server.words_[term_id] = reader.ReadString();
+        server.term_ids_.emplace(server.words_[term_id], term_id);
+    }
+    
+    const vector<int> ids = reader.ReadArray<int>();
+    const vector<int> ratings = reader.ReadArray<int>();
+    const vector<int> statuses = reader.ReadArray<int>();
+    const vector<double> inv_word_counts = reader.ReadArray<double>();
+    const vector<uint8_t> is_present = reader.ReadArray<uint8_t>();
+    if (ratings.size() != ids.size() || statuses.size() != ids.size() || inv_word_counts.size() != ids.size()
+        || is_present.size() != ids.size()) {
+        throw runtime_error(path + " is corrupted"s);
+    }
+    for (size_t index = 0; index < ids.size(); ++index) {
+        if (statuses[index] < 0 || statuses[index] >= DOCUMENT_STATUS_COUNT) {
+            throw runtime_error(path + " is corrupted"s);
+        }
+        server.documents_.push_back({ids[index], ratings[index], static_cast<DocumentStatus>(statuses[index]),
+                                     inv_word_counts[index], !is_present[index]});
+        if (!is_present[index]) {
+            ++server.removed_document_count_;
+        } else {
+            server.document_indexes_.emplace(ids[index], static_cast<int>(index));
+            server.all_ids_.insert(ids[index]);
+        }
+    }
+    
+    // The forward index isn't stored, it's restored from the postings:
+    // the terms of every document are counted, then placed in term id order
+    vector<size_t>& forward_offsets = server.forward_offsets_;
+    forward_offsets.assign(ids.size() + 1, 0);
+    
+    server.postings_.resize(term_count);
+    for (uint32_t term_id = 0; term_id < term_count; ++term_id) {
+        TermPostings& term_postings = server.postings_[term_id];
+        int document_freq = 0;
+        for (PostingList& postings : term_postings.by_status) {
+            const vector<int> indexes = reader.ReadArray<int>();
+            const vector<uint32_t> term_counts = reader.ReadArray<uint32_t>();
+            if (term_counts.size() != indexes.size()
+                || adjacent_find(indexes.begin(), indexes.end(), greater_equal<int>()) != indexes.end()
+                || (!indexes.empty() && (indexes.front() < 0 || indexes.back() >= static_cast<int>(ids.size())))) {
+                throw runtime_error(path + " is corrupted"s);
+            }
+            for (size_t i = 0; i < indexes.size(); ++i) {
+                const int index = indexes[i];
+                if (is_present[index]) {
+                    ++forward_offsets[index + 1];
+                    ++document_freq;
+                }
+                postings.Insert(index, term_counts[i], term_counts[i] * inv_word_counts[index]);
+            }
+        }
+        term_postings.document_freq = document_freq;
+        term_postings.RefreshLogDocumentFreq();
+    }
+    partial_sum(forward_offsets.begin(), forward_offsets.end(), forward_offsets.begin());
+    server.forward_term_ids_.resize(forward_offsets.back());
+    server.forward_term_counts_.resize(forward_offsets.back());
+    vector<size_t> positions(forward_offsets.begin(), forward_offsets.end() - 1);
+    for (uint32_t term_id = 0; term_id < term_count; ++term_id) {
+        for (const PostingList& postings : server.postings_[term_id].by_status) {
+            postings.ForEachInBlocks(0, postings.GetBlockCount(), [&](int index, uint32_t term_count) {
+                if (is_present[index]) {
+                    server.forward_term_ids_[positions[index]] = term_id;
+                    server.forward_term_counts_[positions[index]] = term_count;
+                    ++positions[index];
+                }
+            });
+        }
+    }
+    return server;
+}
+
+void SearchServer::PurgeRemovedDocuments() {
+    vector<int> new_indexes(documents_.size(), -1);
+    vector<DocumentData> documents;
+    documents.reserve(documents_.size() - removed_document_count_);
+    // The forward index is compacted in place, live documents only move towards the front
+    size_t forward_size = 0;
+    for (size_t index = 0; index < documents_.size(); ++index) {
+        const size_t begin = forward_offsets_[index];
+        const size_t end = forward_offsets_[index + 1];
+        if (!documents_[index].is_removed) {
+            new_indexes[index] = static_cast<int>(documents.size());
+            documents.push_back(documents_[index]);
+            copy(forward_term_ids_.begin() + begin, forward_term_ids_.begin() + end, forward_term_ids_.begin() + forward_size);
+            copy(forward_term_counts_.begin() + begin, forward_term_counts_.begin() + end, forward_term_counts_.begin() + forward_size);
+            forward_size += end - begin;
+            forward_offsets_[documents.size()] = forward_size;
+        }
+    }
+    forward_offsets_.resize(documents.size() + 1);
+    forward_term_ids_.resize(forward_size);
+    forward_term_counts_.resize(forward_size);
+    // Blocks are encoded once, so the postings of live documents are reinserted with new indexes
+    for (TermPostings& term_postings : postings_) {
+        term_postings.RefreshLogDocumentFreq();
+        for (PostingList& postings : term_postings.by_status) {
+            PostingList renumbered;
+            postings.ForEachInBlocks(0, postings.GetBlockCount(), [&](int index, uint32_t term_count) {
+                const int new_index = new_indexes[index];
+                if (new_index >= 0) {
+                    renumbered.Insert(new_index, term_count, term_count * documents[new_index].inv_word_count);
+                }
+            });
+            postings = move(renumbered);
+        }
+    }
+    for (auto& [document_id, index] : document_indexes_) {
+        index = new_indexes[index];
+    }
+    documents_ = move(documents);
+    removed_document_count_ = 0;
+    CompactTerms();
+}
+
+void SearchServer::CompactTerms() {
+    const bool has_unused_terms = any_of(postings_.begin(), postings_.end(), [](const TermPostings& term_postings) {
+        return term_postings.document_freq == 0;
+    });
+    if (!has_unused_terms) {
+        return;
+    }
+    // New term ids keep the order of the old ones, so the forward index stays sorted
+    TermPool term_pool;
+    vector<int> new_term_ids(postings_.size(), -1);
+    vector<string_view> words;
+    vector<TermPostings> postings;
+    for (size_t term_id = 0; term_id < postings_.size(); ++term_id) {
+        if (postings_[term_id].document_freq > 0) {
+            new_term_ids[term_id] = static_cast<int>(postings.size());
+            words.push_back(term_pool.Add(words_[term_id]));
+            postings.push_back(move(postings_[term_id]));
+        }
+    }
+    map<string_view, int> term_ids;
+    for (const auto [word, term_id] : term_ids_) {
+        if (new_term_ids[term_id] >= 0) {
+            term_ids.emplace_hint(term_ids.end(), words[new_term_ids[term_id]], new_term_ids[term_id]);
+        }
+    }
+    // Purged documents are gone, so all the terms of the forward index are live
+    for (int& term_id : forward_term_ids_) {
+        term_id = new_term_ids[term_id];
+    }
+    term_ids_ = move(term_ids);
+    words_ = move(words);
+    postings_ = move(postings);
+    term_pool_ = move(term_pool);
+    snapshot_file_.reset();
 }
 
 bool SearchServer::IsStopWord(const string_view word) const {
     return stop_words_.count(word) > 0;
 }
 
+int SearchServer::FindTermId(const string_view word) const {
+    const auto it = term_ids_.find(word);
+    if (it == term_ids_.end())
+        return -1;
+    return it->second;
+}
+
+bool SearchServer::HasWord(const string_view word, int index) const {
+    const int term_id = FindTermId(word);
+    return term_id >= 0
+        && binary_search(forward_term_ids_.begin() + forward_offsets_[index],
+                         forward_term_ids_.begin() + forward_offsets_[index + 1], term_id);
+}
+
 bool SearchServer::IsValidWord(const string_view word) {
     // A valid word must not contain special characters
     return none_of(word.begin(), word.end(), [](char c) {
@@ -91,17 +508,17 @@ bool SearchServer::IsValidWord(const string_view word) {
     });
 }
 
-vector<string_view> SearchServer::SplitIntoWordsNoStop(const string_view text) const {
-    vector<string_view> words;
-    for (const string_view word : SplitIntoWords(text)) {
-        if (!IsValidWord(word)) {
-            throw invalid_argument("Word "s + string{word} + " is invalid"s);
-        }
-        if (!IsStopWord(word)) {
-            words.push_back(word);
-        }
+void SearchServer::SplitIntoWordsNoStop(const string_view text, vector<string_view>& words) const {
+    if (!SplitIntoWords(text, words)) {
+        // The tokenizer only reports that there are control characters, the word is looked up for the message
+        const string_view word = *find_if_not(words.begin(), words.end(), [](const string_view word) {
+            return IsValidWord(word);
+        });
+        throw invalid_argument("Word "s + string{word} + " is invalid"s);
     }
-    return words;
+    words.erase(remove_if(words.begin(), words.end(), [this](const string_view word) {
+        return IsStopWord(word);
+    }), words.end());
 }
 
 int SearchServer::ComputeAverageRating(const vector<int>& ratings) {
@@ -116,25 +533,80 @@ int SearchServer::ComputeAverageRating(const vector<int>& ratings) {
 }
 
 SearchServer::QueryWord SearchServer::ParseQueryWord(const string_view text) const {
-    if (text.empty()) {
-        throw invalid_argument("Query word is empty"s);
-    }
     string_view word = text;
     bool is_minus = false;
     if (word[0] == '-') {
         is_minus = true;
         word.remove_prefix(1);
     }
-    if (word.empty() || word[0] == '-' || !IsValidWord(word)) {
+    if (word.empty() || word[0] == '-') {
         throw invalid_argument("Query word "s + string{text} + " is invalid");
     }
 
     return {word, is_minus, IsStopWord(word)};
 }
 
-SearchServer::Query SearchServer::ParseQuery(const string_view text, bool is_sort) const {
-    Query result;
-    for (const string_view word : SplitIntoWords(text)) {
+SearchServer::QueryContext& SearchServer::GetThreadQueryContext() {
+    thread_local QueryContext context;
+    return context;
+}
+
+void SearchServer::ResolveQuery(QueryContext& context, StatusMask statuses, const QueryStatistics* statistics) const {
+    const vector<string_view>& plus_words = context.query.plus_words;
+    if (statistics && statistics->document_freqs.size() != plus_words.size()) {
+        throw invalid_argument("Statistics don't match the query"s);
+    }
+    const double log_document_count = log(statistics ? statistics->document_count : GetDocumentCount());
+    context.terms.clear();
+    for (size_t i = 0; i < plus_words.size(); ++i) {
+        const int term_id = FindTermId(plus_words[i]);
+        if (term_id >= 0 && postings_[term_id].document_freq > 0) {
+            const double inverse_document_freq = statistics ? log_document_count - log(statistics->document_freqs[i])
+                                                            : ComputeWordInverseDocumentFreq(term_id, log_document_count);
+            AppendPlusTerm(term_id, inverse_document_freq, statuses, context.terms);
+        }
+    }
+    context.excluded.clear();
+    for (const string_view word : context.query.minus_words) {
+        const int term_id = FindTermId(word);
+        if (term_id >= 0) {
+            AppendMinusTerm(term_id, statuses, context.excluded);
+        }
+    }
+}
+
+void SearchServer::AppendPlusTerm(int term_id, double inverse_document_freq, StatusMask statuses, vector<ScoredTerm>& terms) const {
+    // A document is in one partition only, so partitions are scored as separate terms
+    for (int status = 0; status < DOCUMENT_STATUS_COUNT; ++status) {
+        const PostingList& postings = postings_[term_id].by_status[status];
+        if ((statuses & (1u << status)) && !postings.empty()) {
+            terms.push_back({&postings, inverse_document_freq});
+        }
+    }
+}
+
+void SearchServer::AppendMinusTerm(int term_id, StatusMask statuses, vector<const PostingList*>& excluded) const {
+    for (int status = 0; status < DOCUMENT_STATUS_COUNT; ++status) {
+        const PostingList& postings = postings_[term_id].by_status[status];
+        if ((statuses & (1u << status)) && !postings.empty()) {
+            excluded.push_back(&postings);
+        }
+    }
+}
+
+void SearchServer::ParseQuery(const string_view text, QueryContext& context, bool is_sort) const {
+    Query& result = context.query;
+    result.plus_words.clear();
+    result.minus_words.clear();
+    // Words are checked for control characters only if the tokenizer has found some
+    const bool has_controls = !SplitIntoWords(text, context.words);
+    if (context.words.empty()) {
+        throw invalid_argument("Query is empty"s);
+    }
+    for (const string_view word : context.words) {
+        if (has_controls && !IsValidWord(word)) {
+            throw invalid_argument("Query word "s + string{word} + " is invalid");
+        }
         const auto query_word = ParseQueryWord(word);
         if (!query_word.is_stop) {
             if (query_word.is_minus) {
@@ -145,7 +617,7 @@ SearchServer::Query SearchServer::ParseQuery(const string_view text, bool is_sor
         }
     }
     if (!is_sort) {
-        return result;
+        return;
     }
     std::sort(result.minus_words.begin(), result.minus_words.end());
     auto unique_minus_words = std::unique(result.minus_words.begin(), result.minus_words.end());
@@ -153,5 +625,4 @@ SearchServer::Query SearchServer::ParseQuery(const string_view text, bool is_sor
      std::sort(result.plus_words.begin(), result.plus_words.end());
     auto unique_plus_words = std::unique(result.plus_words.begin(), result.plus_words.end());
     result.plus_words.erase(unique_plus_words, result.plus_words.end());
-    return result;
 }
@@ -1,19 +1,46 @@
 #pragma once
 #include "string_processing.h"
-#include "concurrent_map.h"
 #include "document.h"
+#include "posting_list.h"
+#include "score_accumulator.h"
+#include "top_documents.h"
+#include "max_score.h"
+#include "concurrent_map.h"
+#include "mapped_file.h"
+#include "term_pool.h"
+#include "word_frequencies.h"
+#include "query_cache.h"
+#include "search_control.h"
+#include "parallel_for_each.h"
 #include <string_view>
+#include <array>
 #include <execution>
 #include <algorithm>
 #include <string>
+#include <numeric>
+#include <thread>
 #include <vector>
-#include <deque>
 #include <cmath>
 #include <set>
 #include <map>
+#include <memory>
+#include <exception>
+#include <future>
 
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
-const auto EPSILON = 1e-6;
+
+// Document frequencies of the plus words of a query. Summed over several servers,
+// they let each of them score with idf of the whole collection
+struct QueryStatistics {
+    int document_count = 0;
+    std::vector<int> document_freqs; // of the distinct plus words in sorted order
+};
+
+enum class ScoringMode {
+    EXHAUSTIVE, // every posting of every plus word is scored
+    MAX_SCORE,  // documents that can't get into the top are skipped, same results
+    QUANTIZED,  // as EXHAUSTIVE with precomputed term frequencies quantized to 16 bits, scores are approximate
+};
 
 class SearchServer {
 public:
@@ -33,55 +60,209 @@ public:
     void AddDocument(int document_id, const std::string_view document, DocumentStatus status,
                      const std::vector<int>& ratings);
     
+    // Adds the batch either completely or not at all: ids and words of all documents
+    // are validated first. Documents are tokenized, then merged into the index in one pass
+    void AddDocuments(const std::vector<RawDocument>& documents);
+    
+    // Same, documents are tokenized according to the policy, e.g. in parallel with execution::par
+    template <typename ExecutionPolicy>
+    void AddDocuments(ExecutionPolicy&& policy, const std::vector<RawDocument>& documents);
+    
+    // The document only becomes a tombstone skipped by searches. Once tombstones make up
+    // 1 / PURGE_RATIO of the documents, the call purges them and compacts the terms,
+    // which takes time proportional to the whole index
     void RemoveDocument(int document_id);
     
     template <typename ExecutionPolicy>
     void RemoveDocument(ExecutionPolicy&& policy, int document_id);
     
-    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus status) const;
+    // top_k limits the number of returned documents, the most relevant are kept
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus status,
+                                           size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
 
     std::vector<Document> FindTopDocuments(const std::string_view raw_query) const;
+    
+    // Stops once control.ShouldStop(), then the best documents found so far are returned as partial.
+    // Documents are scanned in index order, so the relevance of the returned ones is exact
+    SearchResult FindTopDocuments(const std::string_view raw_query, DocumentStatus status, const SearchControl& control,
+                                  size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
+    
+    // Scores with idf computed from statistics instead of this server's own,
+    // e.g. summed over the shards of a collection
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus status, const QueryStatistics& statistics,
+                                           size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
+    
+    QueryStatistics GetQueryStatistics(const std::string_view raw_query) const;
+    
+    // Runs the search above on a separate thread.
+    // The server must not be modified or destroyed until the result is ready
+    std::future<SearchResult> FindTopDocumentsAsync(std::string raw_query, DocumentStatus status, SearchControl control,
+                                                    size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
 
     template <typename ExecutionPolicy>
-    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL) const;
+    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL,
+                                           size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
     
     template <typename ExecutionPolicy, typename DocumentPredicate>
-    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query, DocumentPredicate document_predicate) const;
+    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query, DocumentPredicate document_predicate,
+                                           size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
     
     template <typename DocumentPredicate>
-    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentPredicate document_predicate) const;
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentPredicate document_predicate,
+                                           size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
 
     int GetDocumentCount() const;
+    
+    // Parallel searches don't support MAX_SCORE and score exhaustively instead
+    void SetScoringMode(ScoringMode mode);
+    
+    // Caches results of searches by status for up to capacity distinct queries.
+    // Queries are normalized, so word order and duplicates don't matter.
+    // Searches with a predicate aren't cached
+    void EnableQueryCache(size_t capacity);
+    
+    // Zeros if the cache isn't enabled
+    QueryCacheStats GetQueryCacheStats() const;
 
+    // Searches for every query like FindTopDocuments, results[i] is for queries[i].
+    // Queries are parsed up front and run in parallel, the most expensive first;
+    // words shared between queries are looked up and get their idf once per batch
+    std::vector<std::vector<Document>> FindTopDocumentsBatch(const std::vector<std::string>& queries,
+                                                             DocumentStatus status = DocumentStatus::ACTUAL,
+                                                             size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
+    
+    // Same, but the results are joined in the order of queries. Every query writes its documents
+    // into its own part of one buffer of queries.size() * min(top_k, GetDocumentCount()) documents
+    std::vector<Document> FindTopDocumentsBatchJoined(const std::vector<std::string>& queries,
+                                                      DocumentStatus status = DocumentStatus::ACTUAL,
+                                                      size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
+    
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::string_view raw_query, int document_id) const;
     
     template <typename ExecutionPolicy>
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const ExecutionPolicy policy, const std::string_view raw_query, int document_id) const;
     
-    auto begin() {
+    auto begin() const {
         return all_ids_.begin();
     }
     
-    auto end() {
+    auto end() const {
         return all_ids_.end();
     }
     
-    const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const;
+    // Empty for unknown documents
+    WordFrequencies GetWordFrequencies(int document_id) const;
+    
+    // Saves the complete index to a versioned binary file. The file is replaced atomically,
+    // so it may be the one this server was loaded from
+    void SaveSnapshot(const std::string& path) const;
+    
+    // Restores an index saved by SaveSnapshot without tokenizing documents again.
+    // The file stays memory-mapped, the term dictionary refers to its strings.
+    static SearchServer LoadSnapshot(const std::string& path);
 
 private:
     struct DocumentData {
+        int id;
         int rating;
         DocumentStatus status;
+        double inv_word_count; // turns term counts into term frequencies
+        bool is_removed = false; // tombstone, the postings are purged later
     };
-    std::deque<std::string> storage;
+    // Document text isn't kept, every distinct term is stored once
+    TermPool term_pool_;
+    std::shared_ptr<const MappedFile> snapshot_file_; // backs term strings of a loaded snapshot until compaction
     const std::set<std::string, std::less<>> stop_words_;
-    std::map<std::string_view, std::map<int, double>> word_to_document_freqs_;
-    std::map<int, DocumentData> documents_;
+    std::map<std::string_view, int> term_ids_; // views into term_pool_ or snapshot_file_
+    std::vector<std::string_view> words_; // indexed by term id
+    // Postings of a term partitioned by document status,
+    // so searching for one status never touches documents with other statuses
+    struct TermPostings {
+        std::array<PostingList, DOCUMENT_STATUS_COUNT> by_status;
+        int document_freq = 0; // removed documents aren't counted, even if not purged yet
+        // log(document_freq) cached for inverse document frequency. AddDocument and RemoveDocument
+        // only count documents, the cache is refreshed once per AddDocuments batch, load and purge
+        double log_document_freq = 0.0;
+        int logged_document_freq = 0;
+
+        void Insert(int index, DocumentStatus status, uint32_t term_count, double term_freq) {
+            by_status[static_cast<int>(status)].Insert(index, term_count, term_freq);
+            ++document_freq;
+        }
+
+        // A term changed after the refresh costs a log per query
+        double GetLogDocumentFreq() const {
+            return document_freq == logged_document_freq ? log_document_freq : log(document_freq);
+        }
+
+        void RefreshLogDocumentFreq() {
+            if (logged_document_freq != document_freq) {
+                log_document_freq = log(document_freq);
+                logged_document_freq = document_freq;
+            }
+        }
+    };
+    
+    // Bit per DocumentStatus, postings of other statuses are skipped
+    using StatusMask = unsigned;
+    static const StatusMask ALL_STATUSES = (1u << DOCUMENT_STATUS_COUNT) - 1;
+    
+    static StatusMask MakeStatusMask(DocumentStatus status) {
+        return 1u << static_cast<int>(status);
+    }
+    
+    // Predicate for searches already restricted by StatusMask
+    struct AcceptAll {
+        bool operator()(int, DocumentStatus, int) const {
+            return true;
+        }
+    };
+    
+    // Stop condition of searches which run to completion
+    struct NeverStop {
+        bool operator()() const {
+            return false;
+        }
+    };
+    
+    std::vector<TermPostings> postings_; // indexed by term id, postings hold document indexes
+    std::vector<DocumentData> documents_; // indexed by dense internal document index
+    std::map<int, int> document_indexes_; // document id -> internal index
+    ScoringMode scoring_mode_ = ScoringMode::EXHAUSTIVE;
     std::set<int> all_ids_;
-    std::map<int, std::map<std::string_view, double>> id_to_w_freqs_;
+    // Forward index: the terms of the document with internal index i are at positions
+    // [forward_offsets_[i], forward_offsets_[i + 1]) of the arrays, sorted by term id
+    std::vector<size_t> forward_offsets_{0};
+    std::vector<int> forward_term_ids_;
+    std::vector<uint32_t> forward_term_counts_;
+    int removed_document_count_ = 0; // tombstones in documents_
+    std::unique_ptr<QueryCache> query_cache_;
+    uint64_t generation_ = 0; // changed by every modification, cached results of other generations are stale
+    
+    // Removed documents are purged once they make up this share of documents_
+    static const int PURGE_RATIO = 4;
+    
+    // Drops the postings of removed documents and renumbers the rest densely,
+    // then compacts the terms
+    void PurgeRemovedDocuments();
+    
+    // Drops terms without documents: the live terms are copied into a new pool
+    // and renumbered keeping their order
+    void CompactTerms();
+    
+    WordFrequencies GetForwardIndex(int index) const {
+        const size_t begin = forward_offsets_[index];
+        return {forward_term_ids_.data() + begin, forward_term_counts_.data() + begin,
+                forward_offsets_[index + 1] - begin, words_, documents_[index].inv_word_count};
+    }
         
     bool IsStopWord(const std::string_view word) const;
     
+    // Returns -1 if the word is absent from the index
+    int FindTermId(const std::string_view word) const;
+    
+    bool HasWord(const std::string_view word, int index) const;
+    
     static bool IsValidWord(const std::string_view word);
     
     template <typename ExecutionPolicy>
@@ -92,7 +273,8 @@ private:
         });
     }
     
-    std::vector<std::string_view> SplitIntoWordsNoStop(const std::string_view text) const;
+    // Fills words, a buffer reused by the caller, with the words of text except stop words
+    void SplitIntoWordsNoStop(const std::string_view text, std::vector<std::string_view>& words) const;
 
     static int ComputeAverageRating(const std::vector<int>& ratings);
 
@@ -102,24 +284,92 @@ private:
         bool is_stop;
     };
 
+    // text is already checked for control characters by ParseQuery
     QueryWord ParseQueryWord(const std::string_view text) const;
 
     struct Query {
         std::vector<std::string_view> plus_words;
         std::vector<std::string_view> minus_words;
     };
+    
+    // Buffers of a query which keep their capacity between queries,
+    // so a query on a warmed-up thread allocates only its result
+    struct QueryContext {
+        std::vector<std::string_view> words; // tokenizer output
+        Query query;
+        std::vector<ScoredTerm> terms;
+        std::vector<const PostingList*> excluded;
+        MaxScoreScratch max_score;
+        std::string cache_key;
+    };
+    
+    // Context reused by sequential queries on the calling thread. Parallel queries use
+    // their own, since a thread waiting inside a parallel algorithm may run another query
+    static QueryContext& GetThreadQueryContext();
 
-    Query ParseQuery(const std::string_view text, bool is_sort = false) const;
+    // Fills context.query, the previous query is dropped
+    void ParseQuery(const std::string_view text, QueryContext& context, bool is_sort = false) const;
+    
+    // Runs the queries of a batch and calls store(i, documents) with the result of queries[i],
+    // concurrently for different queries
+    template <typename ResultStore>
+    void RunTopDocumentsBatch(const std::vector<std::string>& queries, DocumentStatus status, size_t top_k, ResultStore store) const;
+    
+    // Returns the cached result of the sorted query in context,
+    // or caches the result of search() unless it's partial
+    template <typename Search>
+    SearchResult FindCachedDocuments(QueryContext& context, DocumentStatus status, size_t top_k, Search search) const;
     
-    double ComputeWordInverseDocumentFreq(const std::string_view word) const {
-        return log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
+    // Fills context.terms with plus words present in the index along with their
+    // inverse document frequencies, and context.excluded with postings of minus words.
+    // idf is computed from statistics if given
+    void ResolveQuery(QueryContext& context, StatusMask statuses, const QueryStatistics* statistics = nullptr) const;
+    
+    // Append the non-empty postings of the term with statuses from the mask
+    void AppendPlusTerm(int term_id, double inverse_document_freq, StatusMask statuses, std::vector<ScoredTerm>& terms) const;
+    
+    void AppendMinusTerm(int term_id, StatusMask statuses, std::vector<const PostingList*>& excluded) const;
+    
+    // log(N / df) computed as log(N) - log(df): log(df) is cached per term,
+    // log(N) is computed once per query
+    double ComputeWordInverseDocumentFreq(int term_id, double log_document_count) const {
+        return log_document_count - postings_[term_id].GetLogDocumentFreq();
     }
 
+    // Scores all matching documents with statuses from the mask
+    // and returns the top_k most relevant, sorted
     template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(const Query& query, DocumentPredicate document_predicate) const;
+    std::vector<Document> FindAllDocuments(QueryContext& context, StatusMask statuses, DocumentPredicate document_predicate, size_t top_k) const;
+    
+    // Sequentially scores the query already resolved into context.terms and context.excluded.
+    // should_stop() is checked periodically, returning true stops the search
+    template <typename DocumentPredicate, typename StopCondition = NeverStop>
+    std::vector<Document> FindResolvedDocuments(QueryContext& context, DocumentPredicate document_predicate, size_t top_k,
+                                                StopCondition should_stop = {}) const;
+    
+    // The document index space is split into ranges scored independently
+    template <typename ExecutionPolicy, typename DocumentPredicate>
+    std::vector<Document> FindAllDocuments(ExecutionPolicy&& policy, QueryContext& context, StatusMask statuses, DocumentPredicate document_predicate, size_t top_k) const;
+    
+    // Parallel searches don't split the index into ranges smaller than this
+    static const int MIN_DOCUMENT_RANGE_SIZE = 1 << 14;
+    
+    // Parallel searches matching less than this share of the index use a sparse accumulator
+    static const int SPARSE_QUERY_RATIO = 16;
     
+    // Postings of all terms are scored in parallel chunks of this size into a lock-free map,
+    // chunks consist of whole posting blocks
     template <typename ExecutionPolicy, typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(ExecutionPolicy&& policy, const Query& query, DocumentPredicate document_predicate) const;
+    std::vector<Document> FindSparseDocuments(ExecutionPolicy&& policy, const std::vector<ScoredTerm>& terms,
+                                              const std::vector<const PostingList*>& excluded,
+                                              DocumentPredicate document_predicate, size_t top_k) const;
+    
+    static const size_t SPARSE_CHUNK_SIZE = 1 << 12;
+    
+    // Exhaustively scores documents with indexes [begin, end) using the accumulator of the calling thread
+    template <typename DocumentPredicate>
+    void ScoreDocumentRange(const std::vector<ScoredTerm>& terms, const std::vector<const PostingList*>& excluded,
+                            int begin, int end, DocumentPredicate document_predicate, TopDocumentsCollector& collector) const;
 };
 
 template <typename StringContainer>
@@ -134,154 +384,378 @@ SearchServer::SearchServer(const StringContainer& stop_words)
 }
 
 template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(const Query& query, DocumentPredicate document_predicate) const {
-    std::map<int, double> document_to_relevance; //мапа результата
-    
-    for (const std::string_view word : query.plus_words) { // проходим все плюс слова запроса
-        if (word_to_document_freqs_.count(word) == 0) { // если ни в 1 доке не было такого слова
-            continue;
-        }
-        const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-        for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-            const auto& document_data = documents_.at(document_id);
-            if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                document_to_relevance[document_id] += term_freq * inverse_document_freq;
-            }
-        }
-    }
+std::vector<Document> SearchServer::FindAllDocuments(QueryContext& context, StatusMask statuses, DocumentPredicate document_predicate, size_t top_k) const {
+    ResolveQuery(context, statuses);
+    return FindResolvedDocuments(context, document_predicate, top_k);
+}
 
-    for (const std::string_view word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-            document_to_relevance.erase(document_id);
+template <typename DocumentPredicate, typename StopCondition>
+std::vector<Document> SearchServer::FindResolvedDocuments(QueryContext& context, DocumentPredicate document_predicate, size_t top_k,
+                                                          StopCondition should_stop) const {
+    if (scoring_mode_ == ScoringMode::MAX_SCORE) {
+        TopDocumentsCollector collector(top_k);
+        if (top_k == 0) {
+            return collector.Finish();
         }
+        CollectTopDocumentsMaxScore(context.terms, context.excluded,
+            [&](int index) {
+                const auto& document_data = documents_[index];
+                return !document_data.is_removed && document_predicate(document_data.id, document_data.status, document_data.rating);
+            },
+            [&](int index) {
+                return documents_[index].inv_word_count;
+            },
+            [&](int index, double relevance) {
+                return Document{documents_[index].id, relevance, documents_[index].rating};
+            },
+            should_stop, collector, context.max_score);
+        return collector.Finish();
+    }
+    
+    // A search which can be stopped scores the index range by range, so the ranges done are scored completely
+    TopDocumentsCollector collector(top_k);
+    const int document_count = static_cast<int>(documents_.size());
+    const int range_size = std::is_same_v<StopCondition, NeverStop> ? std::max(document_count, 1) : MIN_DOCUMENT_RANGE_SIZE;
+    for (int begin = 0; begin < document_count && !should_stop(); begin += range_size) {
+        ScoreDocumentRange(context.terms, context.excluded, begin, std::min(begin + range_size, document_count), document_predicate, collector);
     }
+    return collector.Finish();
+}
 
-    std::vector<Document> matched_documents;
-    for (const auto [document_id, relevance] : document_to_relevance) {
-        matched_documents.push_back(
-            {document_id, relevance, documents_.at(document_id).rating});
+template <typename ExecutionPolicy, typename DocumentPredicate>
+std::vector<Document> SearchServer::FindAllDocuments(ExecutionPolicy&& policy, QueryContext& context, StatusMask statuses, DocumentPredicate document_predicate, size_t top_k) const {
+    ResolveQuery(context, statuses);
+    const std::vector<ScoredTerm>& terms = context.terms;
+    const std::vector<const PostingList*>& excluded = context.excluded;
+    
+    const int document_count = static_cast<int>(documents_.size());
+    size_t posting_count = 0;
+    for (const ScoredTerm& term : terms) {
+        posting_count += term.postings->size();
+    }
+    if (posting_count * SPARSE_QUERY_RATIO < static_cast<size_t>(document_count)) {
+        return FindSparseDocuments(policy, terms, excluded, document_predicate, top_k);
+    }
+    
+    // Every range gets its own accumulator and top, so threads share nothing until the merge
+    const int max_range_count = static_cast<int>(std::max(1u, std::thread::hardware_concurrency())) * 4;
+    const int range_count = std::clamp(document_count / MIN_DOCUMENT_RANGE_SIZE, 1, max_range_count);
+    
+    std::vector<TopDocumentsCollector> collectors(range_count, TopDocumentsCollector(top_k));
+    std::vector<int> ranges(range_count);
+    std::iota(ranges.begin(), ranges.end(), 0);
+    std::for_each(policy, ranges.begin(), ranges.end(), [&](int range) {
+        const int begin = static_cast<int>(static_cast<int64_t>(document_count) * range / range_count);
+        const int end = static_cast<int>(static_cast<int64_t>(document_count) * (range + 1) / range_count);
+        ScoreDocumentRange(terms, excluded, begin, end, document_predicate, collectors[range]);
+    });
+    
+    TopDocumentsCollector collector(top_k);
+    for (const TopDocumentsCollector& range_collector : collectors) {
+        collector.Merge(range_collector);
     }
-    return matched_documents;
+    return collector.Finish();
 }
 
 template <typename ExecutionPolicy, typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(ExecutionPolicy&& policy, const Query& query, DocumentPredicate document_predicate) const {
-    ConcurrentMap<int, double> document_to_relevance(100);
-    std::for_each(policy, query.plus_words.begin(), query.plus_words.end(), [&](const auto& word) {
-        if (word_to_document_freqs_.count(word) != 0) {
-            const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-            for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-                const auto& document_data = documents_.at(document_id);
-                if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                    document_to_relevance[document_id].ref_to_value += term_freq * inverse_document_freq;
-                }
-            }
+std::vector<Document> SearchServer::FindSparseDocuments(ExecutionPolicy&& policy, const std::vector<ScoredTerm>& terms,
+                                                        const std::vector<const PostingList*>& excluded,
+                                                        DocumentPredicate document_predicate, size_t top_k) const {
+    struct Chunk {
+        const ScoredTerm* term;
+        size_t first_block;
+        size_t end_block;
+    };
+    const size_t chunk_blocks = SPARSE_CHUNK_SIZE / PostingList::BLOCK_SIZE;
+    std::vector<Chunk> chunks;
+    size_t posting_count = 0;
+    for (const ScoredTerm& term : terms) {
+        const size_t block_count = term.postings->GetBlockCount();
+        for (size_t first_block = 0; first_block < block_count; first_block += chunk_blocks) {
+            chunks.push_back({&term, first_block, std::min(first_block + chunk_blocks, block_count)});
         }
-    });
-    std::for_each(policy, query.minus_words.begin(), query.minus_words.end(), [&](const auto& word) {
-        if (word_to_document_freqs_.count(word) != 0) {
-            for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-                document_to_relevance.erase(document_id);
+        posting_count += term.postings->size();
+    }
+    
+    std::vector<int> excluded_indexes;
+    for (const PostingList* postings : excluded) {
+        postings->ForEachInBlocks(0, postings->GetBlockCount(), [&](int index, uint32_t) {
+            excluded_indexes.push_back(index);
+        });
+    }
+    std::sort(excluded_indexes.begin(), excluded_indexes.end());
+    
+    // The number of postings bounds the number of matched documents
+    ConcurrentMap<int, double> document_to_relevance(posting_count);
+    std::for_each(policy, chunks.begin(), chunks.end(), [&](const Chunk& chunk) {
+        const double inverse_document_freq = chunk.term->inverse_document_freq;
+        const auto score_posting = [&](int index, auto get_term_freq) {
+            if (std::binary_search(excluded_indexes.begin(), excluded_indexes.end(), index)) {
+                return;
             }
+            const auto& document_data = documents_[index];
+            if (!document_data.is_removed && document_predicate(document_data.id, document_data.status, document_data.rating)) {
+                document_to_relevance.Add(index, get_term_freq(document_data) * inverse_document_freq);
+            }
+        };
+        if (scoring_mode_ == ScoringMode::QUANTIZED) {
+            chunk.term->postings->ForEachQuantizedInBlocks(chunk.first_block, chunk.end_block, [&](int index, double term_freq) {
+                score_posting(index, [term_freq](const DocumentData&) {
+                    return term_freq;
+                });
+            });
+        } else {
+            chunk.term->postings->ForEachInBlocks(chunk.first_block, chunk.end_block, [&](int index, uint32_t term_count) {
+                score_posting(index, [term_count](const DocumentData& document_data) {
+                    return term_count * document_data.inv_word_count;
+                });
+            });
         }
     });
-    std::vector<Document> matched_documents;
-    for (const auto [document_id, relevance] : document_to_relevance.BuildOrdinaryMap()) {
-        matched_documents.push_back({document_id, relevance, documents_.at(document_id).rating});
+    
+    TopDocumentsCollector collector(top_k);
+    for (const auto& [index, relevance] : document_to_relevance.BuildVector()) {
+        collector.Push({documents_[index].id, relevance, documents_[index].rating});
     }
-    return matched_documents;
+    return collector.Finish();
 }
 
+template <typename DocumentPredicate>
+void SearchServer::ScoreDocumentRange(const std::vector<ScoredTerm>& terms, const std::vector<const PostingList*>& excluded,
+                                      int begin, int end, DocumentPredicate document_predicate, TopDocumentsCollector& collector) const {
+    // The accumulator is indexed by offsets from begin
+    ScoreAccumulator& accumulator = GetThreadScoreAccumulator();
+    accumulator.Reset();
+    accumulator.Prepare(end - begin);
+    
+    // Documents with minus words are excluded first, so they are never scored
+    for (const PostingList* postings : excluded) {
+        postings->ForEach(begin, end, [&](int index, uint32_t) {
+            accumulator.Exclude(index - begin);
+        });
+    }
+    
+    for (const ScoredTerm& term : terms) { // проходим все плюс слова запроса
+        const auto score_posting = [&](int index, auto get_term_freq) {
+            if (accumulator.IsExcluded(index - begin)) {
+                return;
+            }
+            const auto& document_data = documents_[index];
+            if (!document_data.is_removed && document_predicate(document_data.id, document_data.status, document_data.rating)) {
+                accumulator.Add(index - begin, get_term_freq(document_data) * term.inverse_document_freq);
+            }
+        };
+        // Quantized term frequencies are precomputed, exact ones need the document length
+        if (scoring_mode_ == ScoringMode::QUANTIZED) {
+            term.postings->ForEachQuantized(begin, end, [&](int index, double term_freq) {
+                score_posting(index, [term_freq](const DocumentData&) {
+                    return term_freq;
+                });
+            });
+        } else {
+            term.postings->ForEach(begin, end, [&](int index, uint32_t term_count) {
+                score_posting(index, [term_count](const DocumentData& document_data) {
+                    return term_count * document_data.inv_word_count;
+                });
+            });
+        }
+    }
+    
+    accumulator.ForEachScored([&](int offset, double relevance) {
+        const auto& document_data = documents_[begin + offset];
+        collector.Push({document_data.id, relevance, document_data.rating});
+    });
+    accumulator.Reset();
+}
 
-
-
-
+template <typename ExecutionPolicy>
+void SearchServer::AddDocuments(ExecutionPolicy&& policy, const std::vector<RawDocument>& documents) {
+    std::set<int> batch_ids;
+    for (const RawDocument& document : documents) {
+        if (document.id < 0 || document_indexes_.count(document.id) > 0 || !batch_ids.insert(document.id).second)
+            throw std::invalid_argument("Invalid document_id");
+    }
+    
+    // Distinct words of a document with their counts, sorted by word,
+    // and term ids: -1 for terms absent from the index before the batch
+    struct TokenizedDocument {
+        std::vector<std::string_view> words;
+        std::vector<uint32_t> term_counts;
+        std::vector<int> term_ids;
+        double inv_word_count = 0.0;
+    };
+    const size_t batch_size = documents.size();
+    std::vector<TokenizedDocument> tokenized(batch_size);
+    ForEachCollectingErrors(policy, batch_size, [&](size_t i) {
+        // The words are tokenized right into the document and deduplicated in place
+        TokenizedDocument& document = tokenized[i];
+        std::vector<std::string_view>& words = document.words;
+        SplitIntoWordsNoStop(documents[i].text, words);
+        std::sort(words.begin(), words.end());
+        document.inv_word_count = 1.0 / words.size();
+        size_t distinct_count = 0;
+        for (size_t begin = 0, end = 0; begin < words.size(); begin = end) {
+            end = std::upper_bound(words.begin() + begin, words.end(), words[begin]) - words.begin();
+            words[distinct_count++] = words[begin];
+            document.term_counts.push_back(static_cast<uint32_t>(end - begin));
+            document.term_ids.push_back(FindTermId(words[begin]));
+        }
+        words.resize(distinct_count);
+    });
+    
+    // New terms get ids in the order of their first occurrence, as if added one by one
+    for (TokenizedDocument& document : tokenized) {
+        for (size_t j = 0; j < document.words.size(); ++j) {
+            if (document.term_ids[j] >= 0) {
+                continue;
+            }
+            auto it = term_ids_.find(document.words[j]);
+            if (it == term_ids_.end()) {
+                it = term_ids_.emplace(term_pool_.Add(document.words[j]), static_cast<int>(postings_.size())).first;
+                words_.push_back(it->first);
+                postings_.emplace_back();
+            }
+            document.term_ids[j] = it->second;
+        }
+    }
+    
+    ++generation_;
+    
+    // Forward index and document data; postings are counted per term
+    const int first_index = static_cast<int>(documents_.size());
+    std::vector<size_t> term_offsets(postings_.size() + 1, 0);
+    std::vector<std::pair<int, uint32_t>> term_counts;
+    for (size_t i = 0; i < batch_size; ++i) {
+        const TokenizedDocument& document = tokenized[i];
+        term_counts.clear();
+        for (size_t j = 0; j < document.term_ids.size(); ++j) {
+            term_counts.emplace_back(document.term_ids[j], document.term_counts[j]);
+            ++term_offsets[document.term_ids[j] + 1];
+        }
+        std::sort(term_counts.begin(), term_counts.end());
+        for (const auto& [term_id, term_count] : term_counts) {
+            forward_term_ids_.push_back(term_id);
+            forward_term_counts_.push_back(term_count);
+        }
+        forward_offsets_.push_back(forward_term_ids_.size());
+        documents_.push_back(DocumentData{documents[i].id, ComputeAverageRating(documents[i].ratings), documents[i].status,
+                                          document.inv_word_count});
+        document_indexes_.emplace(documents[i].id, first_index + static_cast<int>(i));
+        all_ids_.insert(documents[i].id);
+    }
+    
+    // Postings of the batch grouped by term, in document index order within a term
+    std::partial_sum(term_offsets.begin(), term_offsets.end(), term_offsets.begin());
+    std::vector<int> batch_postings(term_offsets.back());
+    std::vector<uint32_t> batch_term_counts(term_offsets.back());
+    std::vector<size_t> positions(term_offsets.begin(), term_offsets.end() - 1);
+    std::vector<int> touched_term_ids;
+    for (size_t i = 0; i < batch_size; ++i) {
+        const TokenizedDocument& document = tokenized[i];
+        for (size_t j = 0; j < document.term_ids.size(); ++j) {
+            const int term_id = document.term_ids[j];
+            if (positions[term_id] == term_offsets[term_id]) {
+                touched_term_ids.push_back(term_id);
+            }
+            batch_postings[positions[term_id]] = first_index + static_cast<int>(i);
+            batch_term_counts[positions[term_id]] = document.term_counts[j];
+            ++positions[term_id];
+        }
+    }
+    
+    // Every term owns separate posting lists, so they are appended to concurrently
+    std::for_each(policy, touched_term_ids.begin(), touched_term_ids.end(), [&](int term_id) {
+        TermPostings& term_postings = postings_[term_id];
+        for (size_t k = term_offsets[term_id]; k < term_offsets[term_id + 1]; ++k) {
+            const DocumentData& document_data = documents_[batch_postings[k]];
+            term_postings.by_status[static_cast<int>(document_data.status)].Insert(
+                batch_postings[k], batch_term_counts[k], batch_term_counts[k] * document_data.inv_word_count);
+        }
+        term_postings.document_freq += static_cast<int>(term_offsets[term_id + 1] - term_offsets[term_id]);
+        term_postings.RefreshLogDocumentFreq();
+    });
+}
 
 template <typename ExecutionPolicy>
 void SearchServer::RemoveDocument(ExecutionPolicy&& policy, int document_id) {
     if (!all_ids_.count(document_id))
         return;
-    std::vector<std::string_view> words;
-    words.reserve(id_to_w_freqs_.at(document_id).size());
+    const int index = document_indexes_.at(document_id);
+    const auto term_ids_begin = forward_term_ids_.begin() + forward_offsets_[index];
+    const auto term_ids_end = forward_term_ids_.begin() + forward_offsets_[index + 1];
     
-    std::transform(id_to_w_freqs_.at(document_id).begin(), id_to_w_freqs_.at(document_id).end(),
-                   std::back_inserter(words),
-                   [](const auto& pair) {
-        return &(pair.first);
+    // The postings are left as they are, the document only becomes a tombstone.
+    // Every term has a separate counter, so they can be updated concurrently
+    std::for_each(policy, term_ids_begin, term_ids_end, [this](int term_id) {
+        --postings_[term_id].document_freq;
     });
     
-    std::for_each(policy, words.begin(), words.end(), [&](const std::string_view str) {
-        word_to_document_freqs_.erase(str);
-    });
-    
-    id_to_w_freqs_.erase(document_id);
-    documents_.erase(document_id);
+    documents_[index].is_removed = true;
+    ++removed_document_count_;
+    document_indexes_.erase(document_id);
     all_ids_.erase(document_id);
+    ++generation_;
+    
+    if (static_cast<size_t>(removed_document_count_) * PURGE_RATIO >= documents_.size()) {
+        PurgeRemovedDocuments();
+    }
 }
 
 template <typename ExecutionPolicy, typename DocumentPredicate>
-std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query, DocumentPredicate document_predicate) const {
-    if(raw_query.empty()) {
-        throw std::invalid_argument(" "s);
-    }
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query, DocumentPredicate document_predicate, size_t top_k) const {
     if (std::is_same_v<std::decay_t<ExecutionPolicy>, std::execution::sequenced_policy>) {
-        return FindTopDocuments(raw_query, document_predicate);
-    }
-    bool need_sorting = true;
-    const Query query = ParseQuery(raw_query, need_sorting);
-    auto matched_documents = FindAllDocuments(policy, query, document_predicate);
-    std::sort(std::execution::par, matched_documents.begin(), matched_documents.end(),
-              [](const Document& lhs, const Document& rhs) {
-        if (std::abs(lhs.relevance - rhs.relevance) < EPSILON) {
-            return lhs.rating > rhs.rating;
-        }
-        else {
-            return lhs.relevance > rhs.relevance;
-        }
-    });
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+        return FindTopDocuments(raw_query, document_predicate, top_k);
     }
-    return matched_documents;
+    QueryContext context;
+    ParseQuery(raw_query, context, true);
+    return FindAllDocuments(policy, context, ALL_STATUSES, document_predicate, top_k);
 }
 
 //Работа функции с предикатом и политикой в параметрах отличается от изложенной ниже, при вызове её с последовательной политикой из этой функции тесты не проходятся
 template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query, DocumentPredicate document_predicate) const {
-    auto query = ParseQuery(raw_query);
-    
-    std::sort(query.minus_words.begin(), query.minus_words.end());
-    auto last = std::unique(query.minus_words.begin(), query.minus_words.end());
-    query.minus_words.erase(last, query.minus_words.end());
-    
-    std::sort(query.plus_words.begin(), query.plus_words.end());
-    last = std::unique(query.plus_words.begin(), query.plus_words.end());
-    query.plus_words.erase(last, query.plus_words.end());
-    
-    auto matched_documents = FindAllDocuments(query, document_predicate);
-    
-    sort(matched_documents.begin(), matched_documents.end(),
-         [](const Document& lhs, const Document& rhs) {
-        if (std::abs(lhs.relevance - rhs.relevance) < EPSILON) {
-            return lhs.rating > rhs.rating;
-        } else {
-            return lhs.relevance > rhs.relevance;
-        }
-    });
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
-    }
-    return matched_documents;
+std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query, DocumentPredicate document_predicate, size_t top_k) const {
+    QueryContext& context = GetThreadQueryContext();
+    ParseQuery(raw_query, context, true);
+    return FindAllDocuments(context, ALL_STATUSES, document_predicate, top_k);
 }
 
 template <typename ExecutionPolicy>
-std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query, DocumentStatus status) const {
-    return SearchServer::FindTopDocuments(policy, raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-        return document_status == status;
-    });
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query, DocumentStatus status, size_t top_k) const {
+    if (std::is_same_v<std::decay_t<ExecutionPolicy>, std::execution::sequenced_policy>) {
+        return FindTopDocuments(raw_query, status, top_k);
+    }
+    QueryContext context;
+    ParseQuery(raw_query, context, true);
+    return FindCachedDocuments(context, status, top_k, [&] {
+        return SearchResult{FindAllDocuments(policy, context, MakeStatusMask(status), AcceptAll{}, top_k)};
+    }).documents;
+}
+
+template <typename Search>
+SearchResult SearchServer::FindCachedDocuments(QueryContext& context, DocumentStatus status, size_t top_k, Search search) const {
+    if (!query_cache_) {
+        return search();
+    }
+    // Words can't contain spaces and plus words can't start with '-', so the key is unambiguous
+    std::string& key = context.cache_key;
+    key.clear();
+    for (const std::string_view word : context.query.plus_words) {
+        key.append(word).push_back(' ');
+    }
+    for (const std::string_view word : context.query.minus_words) {
+        key.append("-").append(word).push_back(' ');
+    }
+    key.append(std::to_string(static_cast<int>(status))).push_back(' ');
+    key.append(std::to_string(top_k));
+    
+    if (auto documents = query_cache_->Find(key, generation_)) {
+        return {std::move(*documents)};
+    }
+    SearchResult result = search();
+    if (!result.is_partial) {
+        query_cache_->Insert(key, generation_, result.documents);
+    }
+    return result;
 }
 
 template <typename ExecutionPolicy>
@@ -290,23 +764,26 @@ std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDoc
         return MatchDocument(raw_query, document_id);
     }
     
-    const auto query = ParseQuery(raw_query);
+    const int index = document_indexes_.at(document_id);
+    QueryContext context;
+    ParseQuery(raw_query, context);
+    const Query& query = context.query;
     std::vector<std::string_view> matched_words;
     
     //Проверка на минус-слова. Если есть хоть одно- возврат пустого вектора
-    if(std::any_of(policy, query.minus_words.begin(), query.minus_words.end(), [document_id, this] (std::string_view word){
-        return word_to_document_freqs_.count(word) && word_to_document_freqs_.at(word).count(document_id);
+    if(std::any_of(policy, query.minus_words.begin(), query.minus_words.end(), [index, this] (std::string_view word){
+        return HasWord(word, index);
     }))
-        return {matched_words, documents_.at(document_id).status};
+        return {matched_words, documents_[index].status};
     
     matched_words.resize(query.plus_words.size());
-    auto end_of_matched_words = std::copy_if(policy, query.plus_words.begin(), query.plus_words.end(), matched_words.begin(), [document_id, this] (std::string_view word){
-        return word_to_document_freqs_.count(word) && word_to_document_freqs_.at(word).count(document_id);
+    auto end_of_matched_words = std::copy_if(policy, query.plus_words.begin(), query.plus_words.end(), matched_words.begin(), [index, this] (std::string_view word){
+        return HasWord(word, index);
     });
     
     std::sort(policy, matched_words.begin(), end_of_matched_words);
     auto iter = std::unique(policy, matched_words.begin(), end_of_matched_words);
     matched_words.erase(iter, matched_words.end());
     
-    return {matched_words, documents_.at(document_id).status};
+    return {matched_words, documents_[index].status};
 }
@@ -0,0 +1,367 @@
+#include "search_shard.h"
+#include "index_snapshot.h"
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+using namespace std;
+
+namespace {
+
+enum class Operation : uint8_t {
+    ADD_DOCUMENT,
+    REMOVE_DOCUMENT,
+    GET_DOCUMENT_COUNT,
+    GET_QUERY_STATISTICS,
+    FIND_TOP_DOCUMENTS,
+    MATCH_DOCUMENT,
+};
+
+// The first byte of a response, an error is followed by its message
+enum class Outcome : uint8_t {
+    OK,
+    INVALID_ARGUMENT,
+    OUT_OF_RANGE,
+    ERROR,
+};
+
+void WriteAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        const ssize_t written = send(fd, data, size, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw runtime_error("Shard connection failed: "s + strerror(errno));
+        }
+        data += written;
+        size -= written;
+    }
+}
+
+// Returns false if the connection was closed before the first byte
+bool ReadAll(int fd, char* data, size_t size) {
+    size_t read_size = 0;
+    while (read_size < size) {
+        const ssize_t received = recv(fd, data + read_size, size - read_size, 0);
+        if (received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw runtime_error("Shard connection failed: "s + strerror(errno));
+        }
+        if (received == 0) {
+            if (read_size == 0) {
+                return false;
+            }
+            throw runtime_error("Shard connection closed in the middle of a message"s);
+        }
+        read_size += received;
+    }
+    return true;
+}
+
+// Messages are encoded by BufferWriter and prefixed with their size.
+// Both sides run on the same machine, values are in the native byte order
+void SendMessage(int fd, const string& message) {
+    const uint64_t size = message.size();
+    WriteAll(fd, reinterpret_cast<const char*>(&size), sizeof(size));
+    WriteAll(fd, message.data(), message.size());
+}
+
+// Returns false if the connection was closed
+bool ReceiveMessage(int fd, string& message) {
+    uint64_t size = 0;
+    if (!ReadAll(fd, reinterpret_cast<char*>(&size), sizeof(size))) {
+        return false;
+    }
+    message.resize(size);
+    if (!ReadAll(fd, message.data(), size) && size > 0) {
+        throw runtime_error("Shard connection closed in the middle of a message"s);
+    }
+    return true;
+}
+
+sockaddr_un MakeAddress(const string& socket_path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        throw invalid_argument("Socket path "s + socket_path + " is too long"s);
+    }
+    memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+    return address;
+}
+
+string HandleRequest(SearchServer& server, const string& request) {
+    SnapshotReader reader(request.data(), request.size());
+    BufferWriter response;
+    response.Write(Outcome::OK);
+    switch (reader.Read<Operation>()) {
+        case Operation::ADD_DOCUMENT: {
+            const int document_id = reader.Read<int>();
+            const string_view document = reader.ReadString();
+            const auto status = reader.Read<DocumentStatus>();
+            const vector<int> ratings = reader.ReadArray<int>();
+            server.AddDocument(document_id, document, status, ratings);
+            break;
+        }
+        case Operation::REMOVE_DOCUMENT:
+            server.RemoveDocument(reader.Read<int>());
+            break;
+        case Operation::GET_DOCUMENT_COUNT:
+            response.Write(server.GetDocumentCount());
+            break;
+        case Operation::GET_QUERY_STATISTICS: {
+            const QueryStatistics statistics = server.GetQueryStatistics(reader.ReadString());
+            response.Write(statistics.document_count).WriteArray(statistics.document_freqs);
+            break;
+        }
+        case Operation::FIND_TOP_DOCUMENTS: {
+            const string_view raw_query = reader.ReadString();
+            const auto status = reader.Read<DocumentStatus>();
+            QueryStatistics statistics;
+            statistics.document_count = reader.Read<int>();
+            statistics.document_freqs = reader.ReadArray<int>();
+            const auto top_k = reader.Read<uint64_t>();
+            response.WriteArray(server.FindTopDocuments(raw_query, status, statistics, top_k));
+            break;
+        }
+        case Operation::MATCH_DOCUMENT: {
+            // The words are sent as positions in the query, the client has its own copy
+            const string_view raw_query = reader.ReadString();
+            const auto [words, status] = server.MatchDocument(raw_query, reader.Read<int>());
+            vector<uint64_t> offsets;
+            vector<uint64_t> sizes;
+            for (const string_view word : words) {
+                offsets.push_back(word.data() - raw_query.data());
+                sizes.push_back(word.size());
+            }
+            response.Write(status).WriteArray(offsets).WriteArray(sizes);
+            break;
+        }
+        default:
+            throw runtime_error("Unknown shard operation"s);
+    }
+    return response.GetData();
+}
+
+string MakeErrorResponse(Outcome outcome, string_view message) {
+    BufferWriter response;
+    response.Write(outcome).WriteString(message);
+    return response.GetData();
+}
+
+} // namespace
+
+void LocalSearchShard::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
+    server_.AddDocument(document_id, document, status, ratings);
+}
+
+void LocalSearchShard::RemoveDocument(int document_id) {
+    server_.RemoveDocument(document_id);
+}
+
+int LocalSearchShard::GetDocumentCount() const {
+    return server_.GetDocumentCount();
+}
+
+QueryStatistics LocalSearchShard::GetQueryStatistics(string_view raw_query) const {
+    return server_.GetQueryStatistics(raw_query);
+}
+
+vector<Document> LocalSearchShard::FindTopDocuments(string_view raw_query, DocumentStatus status,
+                                                    const QueryStatistics& statistics, size_t top_k) const {
+    return server_.FindTopDocuments(raw_query, status, statistics, top_k);
+}
+
+tuple<vector<string_view>, DocumentStatus> LocalSearchShard::MatchDocument(string_view raw_query, int document_id) const {
+    return server_.MatchDocument(raw_query, document_id);
+}
+
+SocketSearchShard::SocketSearchShard(const string& socket_path)
+    : fd_(socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) {
+    if (fd_ < 0) {
+        throw runtime_error("Can't create a socket: "s + strerror(errno));
+    }
+    try {
+        const sockaddr_un address = MakeAddress(socket_path);
+        if (connect(fd_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+            throw runtime_error("Can't connect to the shard at "s + socket_path + ": "s + strerror(errno));
+        }
+    } catch (...) {
+        close(fd_);
+        throw;
+    }
+}
+
+unique_ptr<SocketSearchShard> SocketSearchShard::Spawn(const string& stop_words_text) {
+    // The server is created before the fork, so invalid stop words are reported to the caller
+    SearchServer server(stop_words_text);
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0) {
+        throw runtime_error("Can't create a socket: "s + strerror(errno));
+    }
+    const pid_t child_pid = fork();
+    if (child_pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        throw runtime_error("Can't start a shard process: "s + strerror(errno));
+    }
+    if (child_pid == 0) {
+        close(fds[0]);
+        try {
+            ServeSearchShardConnection(server, fds[1]);
+        } catch (...) {
+            _exit(1);
+        }
+        _exit(0);
+    }
+    close(fds[1]);
+    return unique_ptr<SocketSearchShard>(new SocketSearchShard(fds[0], child_pid));
+}
+
+SocketSearchShard::~SocketSearchShard() {
+    // Other children may have inherited the socket, shutdown reaches the shard anyway
+    shutdown(fd_, SHUT_RDWR);
+    close(fd_);
+    if (child_pid_ > 0) {
+        waitpid(child_pid_, nullptr, 0);
+    }
+}
+
+void SocketSearchShard::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
+    BufferWriter request;
+    request.Write(Operation::ADD_DOCUMENT).Write(document_id).WriteString(document).Write(status).WriteArray(ratings);
+    Call(request.GetData());
+}
+
+void SocketSearchShard::RemoveDocument(int document_id) {
+    BufferWriter request;
+    request.Write(Operation::REMOVE_DOCUMENT).Write(document_id);
+    Call(request.GetData());
+}
+
+int SocketSearchShard::GetDocumentCount() const {
+    BufferWriter request;
+    request.Write(Operation::GET_DOCUMENT_COUNT);
+    const string response = Call(request.GetData());
+    return SnapshotReader(response.data(), response.size()).Read<int>();
+}
+
+QueryStatistics SocketSearchShard::GetQueryStatistics(string_view raw_query) const {
+    BufferWriter request;
+    request.Write(Operation::GET_QUERY_STATISTICS).WriteString(raw_query);
+    const string response = Call(request.GetData());
+    SnapshotReader reader(response.data(), response.size());
+    QueryStatistics statistics;
+    statistics.document_count = reader.Read<int>();
+    statistics.document_freqs = reader.ReadArray<int>();
+    return statistics;
+}
+
+vector<Document> SocketSearchShard::FindTopDocuments(string_view raw_query, DocumentStatus status,
+                                                     const QueryStatistics& statistics, size_t top_k) const {
+    BufferWriter request;
+    request.Write(Operation::FIND_TOP_DOCUMENTS).WriteString(raw_query).Write(status)
+        .Write(statistics.document_count).WriteArray(statistics.document_freqs).Write(static_cast<uint64_t>(top_k));
+    const string response = Call(request.GetData());
+    return SnapshotReader(response.data(), response.size()).ReadArray<Document>();
+}
+
+tuple<vector<string_view>, DocumentStatus> SocketSearchShard::MatchDocument(string_view raw_query, int document_id) const {
+    BufferWriter request;
+    request.Write(Operation::MATCH_DOCUMENT).WriteString(raw_query).Write(document_id);
+    const string response = Call(request.GetData());
+    SnapshotReader reader(response.data(), response.size());
+    const auto status = reader.Read<DocumentStatus>();
+    const vector<uint64_t> offsets = reader.ReadArray<uint64_t>();
+    const vector<uint64_t> sizes = reader.ReadArray<uint64_t>();
+    if (sizes.size() != offsets.size()) {
+        throw runtime_error("Malformed shard response"s);
+    }
+    vector<string_view> words;
+    for (size_t i = 0; i < offsets.size(); ++i) {
+        if (offsets[i] > raw_query.size() || sizes[i] > raw_query.size() - offsets[i]) {
+            throw runtime_error("Malformed shard response"s);
+        }
+        words.push_back(raw_query.substr(offsets[i], sizes[i]));
+    }
+    return {words, status};
+}
+
+string SocketSearchShard::Call(const string& request) const {
+    string response;
+    {
+        lock_guard guard(mutex_);
+        SendMessage(fd_, request);
+        if (!ReceiveMessage(fd_, response)) {
+            throw runtime_error("Shard connection closed"s);
+        }
+    }
+    SnapshotReader reader(response.data(), response.size());
+    const auto outcome = reader.Read<Outcome>();
+    if (outcome != Outcome::OK) {
+        const string message(reader.ReadString());
+        switch (outcome) {
+            case Outcome::INVALID_ARGUMENT:
+                throw invalid_argument(message);
+            case Outcome::OUT_OF_RANGE:
+                throw out_of_range(message);
+            default:
+                throw runtime_error(message);
+        }
+    }
+    return response.substr(sizeof(Outcome));
+}
+
+void ServeSearchShardConnection(SearchServer& server, int fd) {
+    string request;
+    while (ReceiveMessage(fd, request)) {
+        string response;
+        try {
+            response = HandleRequest(server, request);
+        } catch (const invalid_argument& e) {
+            response = MakeErrorResponse(Outcome::INVALID_ARGUMENT, e.what());
+        } catch (const out_of_range& e) {
+            response = MakeErrorResponse(Outcome::OUT_OF_RANGE, e.what());
+        } catch (const exception& e) {
+            response = MakeErrorResponse(Outcome::ERROR, e.what());
+        }
+        SendMessage(fd, response);
+    }
+}
+
+void ServeSearchShard(const string& socket_path, const string& stop_words_text) {
+    SearchServer server(stop_words_text);
+    const sockaddr_un address = MakeAddress(socket_path);
+    const int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0) {
+        throw runtime_error("Can't create a socket: "s + strerror(errno));
+    }
+    if (bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0) {
+        const string error = strerror(errno);
+        close(listener);
+        throw runtime_error("Can't listen at "s + socket_path + ": "s + error);
+    }
+    while (true) {
+        const int fd = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            const string error = strerror(errno);
+            close(listener);
+            throw runtime_error("Can't accept a shard connection: "s + error);
+        }
+        try {
+            ServeSearchShardConnection(server, fd);
+        } catch (const runtime_error&) {
+            // The client is gone, the shard keeps serving the next ones
+        }
+        close(fd);
+    }
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include "search_server.h"
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+#include <sys/types.h>
+
+// A part of the collection of ShardedSearchServer
+class SearchShard {
+public:
+    virtual ~SearchShard() = default;
+
+    virtual void AddDocument(int document_id, std::string_view document, DocumentStatus status,
+                             const std::vector<int>& ratings) = 0;
+
+    virtual void RemoveDocument(int document_id) = 0;
+
+    virtual int GetDocumentCount() const = 0;
+
+    virtual QueryStatistics GetQueryStatistics(std::string_view raw_query) const = 0;
+
+    virtual std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status,
+                                                   const QueryStatistics& statistics, size_t top_k) const = 0;
+
+    // The words refer to raw_query
+    virtual std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::string_view raw_query,
+                                                                                    int document_id) const = 0;
+};
+
+// Shard in this process
+class LocalSearchShard : public SearchShard {
+public:
+    explicit LocalSearchShard(const std::string& stop_words_text)
+        : server_(stop_words_text) {
+    }
+
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status,
+                     const std::vector<int>& ratings) override;
+    void RemoveDocument(int document_id) override;
+    int GetDocumentCount() const override;
+    QueryStatistics GetQueryStatistics(std::string_view raw_query) const override;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status,
+                                           const QueryStatistics& statistics, size_t top_k) const override;
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::string_view raw_query,
+                                                                            int document_id) const override;
+
+private:
+    SearchServer server_;
+};
+
+// Shard served by another process over a Unix socket. Requests to one shard are serialized;
+// errors of the shard are rethrown as invalid_argument, out_of_range or runtime_error
+class SocketSearchShard : public SearchShard {
+public:
+    // Connects to a shard served by ServeSearchShard
+    explicit SocketSearchShard(const std::string& socket_path);
+
+    // Starts a child process serving a new empty shard, it exits when the shard is destroyed
+    static std::unique_ptr<SocketSearchShard> Spawn(const std::string& stop_words_text);
+
+    SocketSearchShard(const SocketSearchShard&) = delete;
+    SocketSearchShard& operator=(const SocketSearchShard&) = delete;
+
+    ~SocketSearchShard() override;
+
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status,
+                     const std::vector<int>& ratings) override;
+    void RemoveDocument(int document_id) override;
+    int GetDocumentCount() const override;
+    QueryStatistics GetQueryStatistics(std::string_view raw_query) const override;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status,
+                                           const QueryStatistics& statistics, size_t top_k) const override;
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::string_view raw_query,
+                                                                            int document_id) const override;
+
+private:
+    int fd_;
+    pid_t child_pid_ = -1;
+    mutable std::mutex mutex_;
+
+    SocketSearchShard(int fd, pid_t child_pid)
+        : fd_(fd)
+        , child_pid_(child_pid) {
+    }
+
+    // Sends the request and returns the response payload
+    std::string Call(const std::string& request) const;
+};
+
+// Serves requests read from the connected socket until the other side closes it
+void ServeSearchShardConnection(SearchServer& server, int fd);
+
+// Listens at socket_path and serves connections to one shard, one at a time. Doesn't return
+void ServeSearchShard(const std::string& socket_path, const std::string& stop_words_text);
@@ -0,0 +1,99 @@
+#include "sharded_search_server.h"
+#include "parallel_for_each.h"
+#include "top_documents.h"
+#include <algorithm>
+#include <execution>
+#include <numeric>
+#include <stdexcept>
+using namespace std;
+
+namespace {
+
+vector<unique_ptr<SearchShard>> MakeShards(const string& stop_words_text, size_t shard_count, ShardMode mode) {
+    vector<unique_ptr<SearchShard>> shards;
+    for (size_t i = 0; i < shard_count; ++i) {
+        if (mode == ShardMode::PROCESS) {
+            shards.push_back(SocketSearchShard::Spawn(stop_words_text));
+        } else {
+            shards.push_back(make_unique<LocalSearchShard>(stop_words_text));
+        }
+    }
+    return shards;
+}
+
+} // namespace
+
+ShardedSearchServer::ShardedSearchServer(const string& stop_words_text, size_t shard_count, ShardMode mode)
+    : ShardedSearchServer(MakeShards(stop_words_text, shard_count, mode)) {
+}
+
+ShardedSearchServer::ShardedSearchServer(vector<unique_ptr<SearchShard>> shards)
+    : shards_(move(shards)) {
+    if (shards_.empty()) {
+        throw invalid_argument("Sharded server needs at least one shard"s);
+    }
+    if (any_of(shards_.begin(), shards_.end(), [](const unique_ptr<SearchShard>& shard) { return !shard; })) {
+        throw invalid_argument("Shard is null"s);
+    }
+}
+
+void ShardedSearchServer::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
+    GetShard(document_id).AddDocument(document_id, document, status, ratings);
+}
+
+void ShardedSearchServer::RemoveDocument(int document_id) {
+    GetShard(document_id).RemoveDocument(document_id);
+}
+
+vector<Document> ShardedSearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status, size_t top_k) const {
+    const size_t shard_count = shards_.size();
+    vector<QueryStatistics> shard_statistics(shard_count);
+    ForEachShard([&](size_t i) {
+        shard_statistics[i] = shards_[i]->GetQueryStatistics(raw_query);
+    });
+    QueryStatistics statistics = shard_statistics[0];
+    for (size_t i = 1; i < shard_count; ++i) {
+        statistics.document_count += shard_statistics[i].document_count;
+        transform(statistics.document_freqs.begin(), statistics.document_freqs.end(), shard_statistics[i].document_freqs.begin(),
+                  statistics.document_freqs.begin(), plus<int>());
+    }
+
+    vector<vector<Document>> shard_documents(shard_count);
+    ForEachShard([&](size_t i) {
+        const vector<int>& document_freqs = shard_statistics[i].document_freqs;
+        // A shard without any of the plus words has nothing to find
+        if (any_of(document_freqs.begin(), document_freqs.end(), [](int document_freq) { return document_freq > 0; })) {
+            shard_documents[i] = shards_[i]->FindTopDocuments(raw_query, status, statistics, top_k);
+        }
+    });
+    TopDocumentsCollector collector(top_k);
+    for (const vector<Document>& documents : shard_documents) {
+        for (const Document& document : documents) {
+            collector.Push(document);
+        }
+    }
+    return collector.Finish();
+}
+
+tuple<vector<string_view>, DocumentStatus> ShardedSearchServer::MatchDocument(string_view raw_query, int document_id) const {
+    return GetShard(document_id).MatchDocument(raw_query, document_id);
+}
+
+int ShardedSearchServer::GetDocumentCount() const {
+    vector<int> counts(shards_.size());
+    ForEachShard([&](size_t i) {
+        counts[i] = shards_[i]->GetDocumentCount();
+    });
+    return accumulate(counts.begin(), counts.end(), 0);
+}
+
+SearchShard& ShardedSearchServer::GetShard(int document_id) const {
+    // Negative ids are routed somewhere too, so the shard reports them as it would without sharding
+    const long long shard_count = static_cast<long long>(shards_.size());
+    return *shards_[((document_id % shard_count) + shard_count) % shard_count];
+}
+
+template <typename Action>
+void ShardedSearchServer::ForEachShard(Action action) const {
+    ForEachCollectingErrors(execution::par, shards_.size(), action);
+}
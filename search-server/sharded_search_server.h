@@ -0,0 +1,48 @@
+#pragma once
+#include "search_shard.h"
+#include <memory>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+enum class ShardMode {
+    IN_PROCESS, // shards are SearchServers of this process
+    PROCESS,    // every shard is served by a child process over a Unix socket
+};
+
+// Collection partitioned by document id between several shards. A query first gathers
+// document frequencies from all shards, so every shard scores with idf of the whole
+// collection and relevance is the same as of one SearchServer with all documents.
+// Shards are queried in parallel and their tops are merged.
+class ShardedSearchServer {
+public:
+    ShardedSearchServer(const std::string& stop_words_text, size_t shard_count, ShardMode mode = ShardMode::IN_PROCESS);
+
+    // Documents with id i belong to shards[i % shards.size()]; the shards must be empty
+    explicit ShardedSearchServer(std::vector<std::unique_ptr<SearchShard>> shards);
+
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+
+    void RemoveDocument(int document_id);
+
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL,
+                                           size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::string_view raw_query, int document_id) const;
+
+    int GetDocumentCount() const;
+
+    size_t GetShardCount() const {
+        return shards_.size();
+    }
+
+private:
+    std::vector<std::unique_ptr<SearchShard>> shards_;
+
+    SearchShard& GetShard(int document_id) const;
+
+    // Runs action(shard_index) for every shard in parallel, the first error is rethrown
+    template <typename Action>
+    void ForEachShard(Action action) const;
+};
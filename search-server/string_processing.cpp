@@ -1,23 +1,86 @@
 #include "string_processing.h"
+#include <algorithm>
+#include <cstdint>
 #include <execution>
 #include <string>
 #include <vector>
 #include <set>
 #include <iostream>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 using namespace std;
 
-std::vector<std::string_view> SplitIntoWords(const std::string_view s) {
-    std::string_view str = s;
-    std::vector<std::string_view> result;
-    
-    while (true) {
-        size_t space = str.find(' ');
-        result.push_back(str.substr(0, space));
-        if (space == str.npos) {
-            break;
-        } else {
-            str.remove_prefix(space + 1);
+namespace {
+
+// Bit i of the masks describes chunk[i]. Control characters are bytes 0..31,
+// so they are found as unsigned bytes equal to their minimum with 31
+#if defined(__AVX2__)
+const size_t CHUNK_SIZE = 32;
+
+void ScanChunk(const char* chunk, uint32_t& spaces, uint32_t& controls) {
+    const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(chunk));
+    spaces = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' '))));
+    controls = static_cast<uint32_t>(_mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(_mm256_min_epu8(bytes, _mm256_set1_epi8(' ' - 1)), bytes)));
+}
+#elif defined(__SSE2__)
+const size_t CHUNK_SIZE = 16;
+
+void ScanChunk(const char* chunk, uint32_t& spaces, uint32_t& controls) {
+    const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(chunk));
+    spaces = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(' '))));
+    controls = static_cast<uint32_t>(_mm_movemask_epi8(
+        _mm_cmpeq_epi8(_mm_min_epu8(bytes, _mm_set1_epi8(' ' - 1)), bytes)));
+}
+#else
+const size_t CHUNK_SIZE = 16;
+
+void ScanChunk(const char* chunk, uint32_t& spaces, uint32_t& controls) {
+    spaces = 0;
+    controls = 0;
+    for (size_t i = 0; i < CHUNK_SIZE; ++i) {
+        const auto c = static_cast<unsigned char>(chunk[i]);
+        spaces |= static_cast<uint32_t>(c == ' ') << i;
+        controls |= static_cast<uint32_t>(c < ' ') << i;
+    }
+}
+#endif
+
+} // namespace
+
+bool SplitIntoWords(const string_view text, vector<string_view>& words) {
+    words.clear();
+    uint32_t found_controls = 0;
+    size_t word_begin = 0;
+    const auto scan_chunk = [&](const char* chunk, size_t offset) {
+        uint32_t spaces, controls;
+        ScanChunk(chunk, spaces, controls);
+        found_controls |= controls;
+        for (; spaces != 0; spaces &= spaces - 1) {
+            const size_t space = offset + __builtin_ctz(spaces);
+            if (space > word_begin) {
+                words.emplace_back(text.data() + word_begin, space - word_begin);
+            }
+            word_begin = space + 1;
         }
+    };
+    
+    size_t offset = 0;
+    for (; offset + CHUNK_SIZE <= text.size(); offset += CHUNK_SIZE) {
+        scan_chunk(text.data() + offset, offset);
     }
+    // The rest is padded with spaces, so the last word ends inside the padded chunk
+    char padded[CHUNK_SIZE];
+    fill(copy(text.begin() + offset, text.end(), padded), padded + CHUNK_SIZE, ' ');
+    scan_chunk(padded, offset);
+    return found_controls == 0;
+}
+
+vector<string_view> SplitIntoWords(const string_view s) {
+    vector<string_view> result;
+    SplitIntoWords(s, result);
     return result;
-}
\ No newline at end of file
+}
@@ -1,9 +1,15 @@
 #pragma once
 #include <execution>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <set>
 
+// Splits text by spaces into words, which refer to text. Empty words aren't produced.
+// Separators and control characters are found in a single vectorized pass.
+// Returns false if text contains control characters; words are split anyway
+bool SplitIntoWords(std::string_view text, std::vector<std::string_view>& words);
+
 std::vector<std::string_view> SplitIntoWords(const std::string_view s);
     
 template <typename StringContainer>
@@ -0,0 +1,19 @@
+#include "term_pool.h"
+#include <algorithm>
+using namespace std;
+
+string_view TermPool::Add(string_view term) {
+    if (term.size() > free_size_) {
+        // The rest of the current chunk is wasted, terms are short compared to a chunk
+        const size_t chunk_size = max(CHUNK_SIZE, term.size());
+        chunks_.push_back(make_unique<char[]>(chunk_size));
+        free_begin_ = chunks_.back().get();
+        free_size_ = chunk_size;
+        capacity_ += chunk_size;
+    }
+    char* const begin = free_begin_;
+    copy(term.begin(), term.end(), begin);
+    free_begin_ += term.size();
+    free_size_ -= term.size();
+    return {begin, term.size()};
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Arena of strings: terms are copied one after another into large chunks.
+// Returned views stay valid until the pool is destroyed, moving the pool keeps them valid too.
+// Single terms can't be freed, a pool is compacted by copying the live terms into a new one.
+class TermPool {
+public:
+    std::string_view Add(std::string_view term);
+
+    // Bytes allocated for chunks
+    size_t GetCapacity() const {
+        return capacity_;
+    }
+
+private:
+    static constexpr size_t CHUNK_SIZE = 1 << 16;
+
+    std::vector<std::unique_ptr<char[]>> chunks_;
+    char* free_begin_ = nullptr;
+    size_t free_size_ = 0;
+    size_t capacity_ = 0;
+};
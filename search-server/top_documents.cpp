@@ -0,0 +1,25 @@
+#include "top_documents.h"
+#include <algorithm>
+using namespace std;
+
+void TopDocumentsCollector::Push(const Document& document) {
+    if (heap_.size() < top_k_) {
+        heap_.push_back(document);
+        push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    } else if (top_k_ > 0 && IsMoreRelevant(document, heap_.front())) {
+        pop_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+        heap_.back() = document;
+        push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    }
+}
+
+void TopDocumentsCollector::Merge(const TopDocumentsCollector& other) {
+    for (const Document& document : other.heap_) {
+        Push(document);
+    }
+}
+
+vector<Document> TopDocumentsCollector::Finish() {
+    sort_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    return move(heap_);
+}
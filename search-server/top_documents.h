@@ -0,0 +1,49 @@
+#pragma once
+#include "document.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+const auto EPSILON = 1e-6;
+
+// Documents with relevance closer than EPSILON are ordered by rating
+inline bool IsMoreRelevant(const Document& lhs, const Document& rhs) {
+    if (std::abs(lhs.relevance - rhs.relevance) < EPSILON) {
+        return lhs.rating > rhs.rating;
+    }
+    return lhs.relevance > rhs.relevance;
+}
+
+// Keeps the top_k most relevant of the pushed documents in a bounded heap,
+// so selecting from n matches costs O(n log k) instead of a full sort
+class TopDocumentsCollector {
+public:
+    explicit TopDocumentsCollector(size_t top_k)
+        : top_k_(top_k) {
+        heap_.reserve(std::min(top_k, MAX_RESERVED_SIZE));
+    }
+
+    void Push(const Document& document);
+
+    void Merge(const TopDocumentsCollector& other);
+
+    bool IsFull() const {
+        return heap_.size() == top_k_;
+    }
+
+    // The least relevant of the kept documents, valid if not empty
+    const Document& GetWorst() const {
+        return heap_.front();
+    }
+
+    // Returns the kept documents, the most relevant first
+    std::vector<Document> Finish();
+
+private:
+    // A larger heap grows as documents are pushed, so a huge top_k allocates nothing up front
+    static constexpr size_t MAX_RESERVED_SIZE = 64;
+
+    size_t top_k_;
+    std::vector<Document> heap_; // the least relevant document on top
+};
@@ -0,0 +1,93 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// View of the terms of one document: iterates over (word, term frequency) pairs
+// ordered by term id. Frequencies are term counts scaled by the inverse document length. Refers to the index, so it's invalidated by its modifications
+class WordFrequencies {
+public:
+    class Iterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = std::pair<std::string_view, double>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = value_type;
+
+        Iterator(const int* term_id, const uint32_t* term_count, const std::vector<std::string_view>* words, double scale)
+            : term_id_(term_id)
+            , term_count_(term_count)
+            , words_(words)
+            , scale_(scale) {
+        }
+
+        value_type operator*() const {
+            return {(*words_)[*term_id_], *term_count_ * scale_};
+        }
+
+        Iterator& operator++() {
+            ++term_id_;
+            ++term_count_;
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            Iterator old = *this;
+            ++*this;
+            return old;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return term_id_ == other.term_id_;
+        }
+
+        bool operator!=(const Iterator& other) const {
+            return term_id_ != other.term_id_;
+        }
+
+    private:
+        const int* term_id_;
+        const uint32_t* term_count_;
+        const std::vector<std::string_view>* words_;
+        double scale_;
+    };
+
+    WordFrequencies() = default;
+
+    // words maps term ids to words, scale is the inverse document length
+    WordFrequencies(const int* term_ids, const uint32_t* term_counts, size_t size, const std::vector<std::string_view>& words,
+                    double scale)
+        : term_ids_(term_ids)
+        , term_counts_(term_counts)
+        , size_(size)
+        , words_(&words)
+        , scale_(scale) {
+    }
+
+    Iterator begin() const {
+        return {term_ids_, term_counts_, words_, scale_};
+    }
+
+    Iterator end() const {
+        return {term_ids_ + size_, term_counts_ + size_, words_, scale_};
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+private:
+    const int* term_ids_ = nullptr;
+    const uint32_t* term_counts_ = nullptr;
+    size_t size_ = 0;
+    const std::vector<std::string_view>* words_ = nullptr;
+    double scale_ = 0.0;
+};